@@ -0,0 +1,178 @@
+#include "batch.hh"
+#include <algorithm>
+
+namespace Voronoi {
+
+namespace {
+
+std::uint64_t pack(std::uint32_t lo, std::uint32_t hi) {
+    return std::uint64_t(hi) << 32 | lo;
+}
+
+} // namespace
+
+template <typename T>
+BasicBatchRunner<T>::BasicBatchRunner(unsigned threads) {
+    threads = std::max(threads, 1u);
+    for (unsigned w = 0; w < threads; ++w) {
+        workers.push_back(std::make_unique<Worker>());
+        // The batch wants nothing but the segments
+        workers.back()->f.set_build_index(false);
+    }
+    for (unsigned w = 1; w < threads; ++w) pool.emplace_back([this, w] { serve(w); });
+}
+
+template <typename T>
+BasicBatchRunner<T>::~BasicBatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : pool) t.join();
+}
+
+template <typename T>
+void BasicBatchRunner<T>::set_clip_rect(double x0, double y0, double x1, double y1) {
+    for (auto& w : workers) w->f.set_clip_rect(x0, y0, x1, y1);
+}
+
+template <typename T>
+void BasicBatchRunner<T>::set_clip_polygon(std::span<const Point> ccw) {
+    for (auto& w : workers) w->f.set_clip_polygon(ccw);
+}
+
+template <typename T>
+void BasicBatchRunner<T>::clear_clip() {
+    for (auto& w : workers) w->f.clear_clip();
+}
+
+template <typename T>
+void BasicBatchRunner<T>::compute(std::span<const std::span<const Site>> batch, BasicSegmentBatch<T>& result) {
+    sets = batch;
+    out = &result;
+    const std::size_t m = sets.size();
+    const std::size_t n = workers.size();
+    counts.assign(m, 0);
+    
+    // Equal runs of diagrams to start with
+    for (std::size_t w = 0; w < n; ++w) {
+        Worker& worker = *workers[w];
+        worker.staged.clear();
+        worker.ran.clear();
+        worker.range.store(pack(static_cast<std::uint32_t>(m * w / n), static_cast<std::uint32_t>(m * (w + 1) / n)));
+    }
+    run(Phase::sweep);
+    
+    result.offsets.resize(m + 1);
+    result.offsets[0] = 0;
+    for (std::size_t i = 0; i < m; ++i) result.offsets[i + 1] = result.offsets[i] + counts[i];
+    // Only a buffer that grows gets written twice
+    result.segments.resize(result.offsets[m], Segment(Site()));
+    run(Phase::copy);
+    
+    sets = {};
+    out = nullptr;
+}
+
+// One phase on every worker, the calling thread doing worker 0's share
+template <typename T>
+void BasicBatchRunner<T>::run(Phase p) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        phase = p;
+        running = static_cast<unsigned>(pool.size());
+        ++generation;
+    }
+    wake.notify_all();
+    work(0);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return running == 0; });
+}
+
+template <typename T>
+void BasicBatchRunner<T>::serve(unsigned w) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(w);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0) idle.notify_one();
+    }
+}
+
+template <typename T>
+void BasicBatchRunner<T>::work(unsigned w) {
+    Worker& worker = *workers[w];
+    if (phase == Phase::sweep) {
+        std::uint32_t i;
+        while (claim(w, i)) {
+            worker.f.reset();
+            worker.f.add_points(sets[i]);
+            worker.f.compute();
+            const std::span<const Segment> segs = worker.f.segments();
+            worker.staged.insert(worker.staged.end(), segs.begin(), segs.end());
+            worker.ran.push_back(i);
+            counts[i] = segs.size();
+        }
+    } else {
+        // Every worker moves its own diagrams to their place
+        const Segment* from = worker.staged.data();
+        for (const std::uint32_t i : worker.ran) {
+            std::copy(from, from + counts[i], out->segments.begin() + out->offsets[i]);
+            from += counts[i];
+        }
+    }
+}
+
+// Next diagram for worker w: the bottom of its own run, or else the first
+// of the upper half of the longest run it finds among the others
+template <typename T>
+bool BasicBatchRunner<T>::claim(unsigned w, std::uint32_t& i) {
+    std::atomic<std::uint64_t>& own = workers[w]->range;
+    std::uint64_t r = own.load();
+    while (std::uint32_t(r) < (r >> 32)) {
+        if (own.compare_exchange_weak(r, r + 1)) {
+            i = std::uint32_t(r);
+            return true;
+        }
+    }
+    
+    for (;;) {
+        unsigned victim = 0;
+        std::uint64_t best = 0, vr = 0;
+        for (unsigned v = 0; v < workers.size(); ++v) {
+            const std::uint64_t x = workers[v]->range.load();
+            const std::uint32_t lo = std::uint32_t(x), hi = std::uint32_t(x >> 32);
+            if (v != w && lo < hi && hi - lo > best) {
+                best = hi - lo;
+                victim = v;
+                vr = x;
+            }
+        }
+        if (best == 0) return false;
+        
+        // Ranges only shrink or move to indices nobody has claimed yet, so
+        // a stale vr fails the exchange instead of taking anything twice
+        const std::uint32_t lo = std::uint32_t(vr), hi = std::uint32_t(vr >> 32);
+        const std::uint32_t mid = hi - static_cast<std::uint32_t>((best + 1) / 2);
+        if (workers[victim]->range.compare_exchange_strong(vr, pack(lo, mid))) {
+            own.store(pack(mid + 1, hi));
+            i = mid;
+            return true;
+        }
+    }
+}
+
+template class BasicBatchRunner<double>;
+template class BasicBatchRunner<float>;
+template class BasicBatchRunner<std::int32_t>;
+
+} // namespace Voronoi
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "voronoi.hh"
+
+namespace Voronoi {
+
+// Segments of many diagrams in one buffer: those of diagram i are
+// segments[offsets[i]] up to segments[offsets[i + 1]]
+template <typename T>
+struct BasicSegmentBatch {
+    std::vector<BasicSegment<T>> segments;
+    std::vector<std::size_t> offsets;
+    
+    std::size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    std::span<const BasicSegment<T>> operator[](std::size_t i) const {
+        return std::span<const BasicSegment<T>>(segments).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+// Many small independent diagrams on a fixed pool of threads, each with a
+// BasicFortuneAlgorithm of its own that it resets and reuses, so batch
+// after batch runs without allocating once the buffers have grown to the
+// largest diagram. The diagrams of a batch are dealt out as one run of
+// consecutive indices per worker; a worker whose run is used up steals
+// the upper half of what is left of another one's. The calling thread is
+// worker 0.
+template <typename T>
+class BasicBatchRunner {
+public:
+    using Site = BasicPoint<T>;
+    using Segment = BasicSegment<T>;
+    
+    explicit BasicBatchRunner(unsigned threads = std::thread::hardware_concurrency());
+    ~BasicBatchRunner();
+    
+    BasicBatchRunner(const BasicBatchRunner&) = delete;
+    BasicBatchRunner& operator=(const BasicBatchRunner&) = delete;
+    
+    // Clip region of every diagram, as in BasicFortuneAlgorithm
+    void set_clip_rect(double x0, double y0, double x1, double y1);
+    void set_clip_polygon(std::span<const Point> ccw);
+    void clear_clip();
+    
+    // Voronoi segments of every site set, in the order of sets. out's
+    // storage is reused from the last batch.
+    void compute(std::span<const std::span<const Site>> sets, BasicSegmentBatch<T>& out);
+    
+    unsigned threads() const { return static_cast<unsigned>(workers.size()); }
+    
+private:
+    struct Worker {
+        BasicFortuneAlgorithm<T> f;
+        std::vector<Segment> staged; // Segments of the diagrams in ran, one after the other
+        std::vector<std::uint32_t> ran;
+        std::atomic<std::uint64_t> range{0}; // Unclaimed diagrams [lo, hi), as hi << 32 | lo
+    };
+    
+    enum class Phase { sweep, copy };
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> pool; // Workers 1 and up
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::uint64_t generation = 0; // Bumped for every phase
+    unsigned running = 0;         // Pool threads still in the current phase
+    bool stopping = false;
+    Phase phase = Phase::sweep;
+    
+    // The batch in flight
+    std::span<const std::span<const Site>> sets;
+    BasicSegmentBatch<T>* out = nullptr;
+    std::vector<std::size_t> counts; // Segments per diagram
+    
+    void run(Phase p);
+    void serve(unsigned w);
+    void work(unsigned w);
+    bool claim(unsigned w, std::uint32_t& i);
+};
+
+using BatchRunner = BasicBatchRunner<double>;
+using BatchRunnerF = BasicBatchRunner<float>;
+using BatchRunnerI = BasicBatchRunner<std::int32_t>;
+using SegmentBatch = BasicSegmentBatch<double>;
+
+} // namespace Voronoi
@@ -0,0 +1,410 @@
+// Benchmarks for the sweep and the queries on its result.
+//
+//   g++ -std=c++20 -O2 -pthread bench.cpp voronoi.cpp site_index.cpp parallel.cpp incremental.cpp predicates.cpp lloyd.cpp batch.cpp cells.cpp window.cpp raster.cpp pipeline.cpp -lbenchmark -o bench
+//
+// Besides time, every benchmark reports sites (or queries) per second, heap
+// allocations per site and the peak heap size reached while it ran.
+#include "batch.hh"
+#include "raster.hh"
+#include "voronoi.hh"
+#include "window.hh"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <random>
+
+// Heap accounting through the global allocator. Every block carries its
+// size in front so frees can be subtracted again.
+namespace {
+
+constexpr std::size_t header = alignof(std::max_align_t);
+
+std::atomic<std::size_t> allocations{0};
+std::atomic<std::size_t> live_bytes{0};
+std::atomic<std::size_t> peak_bytes{0};
+
+void* counted_alloc(std::size_t size) {
+    void* p = std::malloc(size + header);
+    if (!p) throw std::bad_alloc();
+    *static_cast<std::size_t*>(p) = size;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return static_cast<char*>(p) + header;
+}
+
+void counted_free(void* p) {
+    if (!p) return;
+    void* block = static_cast<char*>(p) - header;
+    live_bytes.fetch_sub(*static_cast<std::size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+
+namespace {
+
+using Voronoi::FortuneAlgorithm;
+using Voronoi::Point;
+
+enum Input { uniform, clustered, grid, sorted };
+
+std::vector<Point> make_sites(Input input, std::size_t n) {
+    std::mt19937_64 rng(n);
+    std::uniform_real_distribution<double> u(0.0, 1000.0);
+    std::vector<Point> sites;
+    sites.reserve(n);
+    
+    switch (input) {
+    case uniform:
+    case sorted:
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({u(rng), u(rng)});
+        if (input == sorted) {
+            std::sort(sites.begin(), sites.end(), [](const Point& a, const Point& b) {
+                return a.x < b.x || (a.x == b.x && a.y < b.y);
+            });
+        }
+        break;
+    case clustered: {
+        // Gaussian blobs, about a thousand sites each
+        std::normal_distribution<double> g(0.0, 5.0);
+        std::vector<Point> centres(std::max<std::size_t>(1, n / 1000));
+        for (Point& c : centres) c = {u(rng), u(rng)};
+        for (std::size_t i = 0; i < n; ++i) {
+            const Point& c = centres[i % centres.size()];
+            sites.push_back({c.x + g(rng), c.y + g(rng)});
+        }
+        break;
+    }
+    case grid: {
+        // Every unit square has four cocircular corners
+        const std::size_t side = static_cast<std::size_t>(std::ceil(std::sqrt(double(n))));
+        for (std::size_t i = 0; i < n; ++i) {
+            sites.push_back({double(i % side), double(i / side)});
+        }
+        std::shuffle(sites.begin(), sites.end(), rng);
+        break;
+    }
+    }
+    return sites;
+}
+
+// Inputs are generated once per shape and size and shared between benchmarks
+const std::vector<Point>& sites_for(Input input, std::size_t n) {
+    static std::map<std::pair<int, std::size_t>, std::vector<Point>> cache;
+    auto it = cache.find({input, n});
+    if (it == cache.end()) it = cache.emplace(std::make_pair(int(input), n), make_sites(input, n)).first;
+    return it->second;
+}
+
+// Counters shared by every benchmark; items is what one iteration handles
+class HeapCounters {
+public:
+    HeapCounters() : start_allocations(allocations.load()) {
+        peak_bytes.store(live_bytes.load());
+        start_bytes = live_bytes.load();
+    }
+    
+    void report(benchmark::State& state, std::size_t items, const char* per) {
+        const double total = double(items) * double(state.iterations());
+        state.counters[std::string(per) + "/s"] = benchmark::Counter(total, benchmark::Counter::kIsRate);
+        state.counters["allocs/" + std::string(per)] = double(allocations.load() - start_allocations) / total;
+        state.counters["peak_MB"] = double(peak_bytes.load() - start_bytes) / (1 << 20);
+    }
+    
+private:
+    std::size_t start_allocations;
+    std::size_t start_bytes;
+};
+
+void compute_into(FortuneAlgorithm& f, const std::vector<Point>& sites) {
+    f.add_points(sites);
+    f.compute();
+}
+
+void BM_compute(benchmark::State& state, Input input) {
+    const std::vector<Point>& sites = sites_for(input, state.range(0));
+    HeapCounters heap;
+    for (auto _ : state) {
+        FortuneAlgorithm f;
+        f.add_points(sites);
+        f.compute();
+        benchmark::DoNotOptimize(f.segments().data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// One object for a stream of tiles, reset between them, as a service
+// would keep it; after the first run nothing is allocated
+void BM_compute_reused(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    FortuneAlgorithm f;
+    f.reserve(sites.size());
+    HeapCounters heap;
+    for (auto _ : state) {
+        f.reset();
+        f.add_points(sites);
+        f.compute();
+        benchmark::DoNotOptimize(f.segments().data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// The same sweep with sites and segments kept as float or int32_t. Sites
+// are scaled up first so the integer grid keeps them apart.
+template <typename T>
+void BM_compute_as(benchmark::State& state) {
+    std::vector<Voronoi::BasicPoint<T>> sites;
+    for (const Point& p : sites_for(uniform, state.range(0))) {
+        sites.emplace_back(Point(p.x * 1024, p.y * 1024));
+    }
+    HeapCounters heap;
+    for (auto _ : state) {
+        Voronoi::BasicFortuneAlgorithm<T> f;
+        f.add_points(sites);
+        f.compute();
+        benchmark::DoNotOptimize(f.segments().data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// Additive weights of up to about the spacing of the sites, so that some
+// of them lose their cell
+void BM_compute_weighted(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    std::mt19937_64 rng(3);
+    std::uniform_real_distribution<double> u(0.0, 1000.0 / std::sqrt(double(sites.size())));
+    std::vector<double> weights(sites.size());
+    for (double& w : weights) w = u(rng);
+    HeapCounters heap;
+    for (auto _ : state) {
+        Voronoi::WeightedFortuneAlgorithm f;
+        f.add_points(sites, weights);
+        f.compute();
+        benchmark::DoNotOptimize(f.segments().data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+void BM_compute_parallel(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    HeapCounters heap;
+    for (auto _ : state) {
+        FortuneAlgorithm f;
+        f.add_points(sites);
+        f.compute_parallel();
+        benchmark::DoNotOptimize(f.segments().data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// Loading, sorting, sweeping and the sink on their own threads, with a
+// sink that only counts what it is given
+void BM_compute_pipelined(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    std::size_t count = 0;
+    HeapCounters heap;
+    for (auto _ : state) {
+        FortuneAlgorithm f;
+        f.set_edge_sink([&count](const Voronoi::Segment&) { ++count; });
+        f.compute_pipelined(sites);
+        benchmark::DoNotOptimize(count);
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// A batch of 256 independent diagrams of range(0) sites each on all cores
+void BM_compute_batch(benchmark::State& state) {
+    const std::size_t n = state.range(0), m = 256;
+    const std::vector<Point>& sites = sites_for(uniform, n * m);
+    std::vector<std::span<const Point>> sets;
+    for (std::size_t i = 0; i < m; ++i) sets.emplace_back(sites.data() + i * n, n);
+    Voronoi::BatchRunner runner;
+    Voronoi::SegmentBatch out;
+    HeapCounters heap;
+    for (auto _ : state) {
+        runner.compute(sets, out);
+        benchmark::DoNotOptimize(out.segments.data());
+    }
+    heap.report(state, sites.size(), "site");
+}
+
+// Ten Lloyd steps on one object; items are site-steps
+void BM_relax(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    HeapCounters heap;
+    for (auto _ : state) {
+        FortuneAlgorithm f;
+        f.add_points(sites);
+        benchmark::DoNotOptimize(f.relax(10).displacement);
+    }
+    heap.report(state, sites.size() * 11, "site");
+}
+
+std::vector<Point> random_queries(std::size_t m) {
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> u(0.0, 1000.0);
+    std::vector<Point> qs(m);
+    for (Point& q : qs) q = {u(rng), u(rng)};
+    return qs;
+}
+
+void BM_locate_cell(benchmark::State& state) {
+    FortuneAlgorithm f;
+    compute_into(f, sites_for(uniform, state.range(0)));
+    const std::vector<Point> qs = random_queries(1 << 16);
+    HeapCounters heap;
+    for (auto _ : state) {
+        for (const Point& q : qs) benchmark::DoNotOptimize(f.locate_cell(q));
+    }
+    heap.report(state, qs.size(), "query");
+}
+
+void BM_locate_cells_raster(benchmark::State& state) {
+    FortuneAlgorithm f;
+    compute_into(f, sites_for(uniform, state.range(0)));
+    const std::size_t side = 256;
+    std::vector<Point> qs;
+    for (std::size_t y = 0; y < side; ++y) {
+        for (std::size_t x = 0; x < side; ++x) qs.push_back({x * 1000.0 / side, y * 1000.0 / side});
+    }
+    std::vector<int> out(qs.size());
+    HeapCounters heap;
+    for (auto _ : state) {
+        f.locate_cells(qs, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    heap.report(state, qs.size(), "query");
+}
+
+// k nearest sites of random queries, grown through the diagram
+void BM_nearest_k(benchmark::State& state) {
+    FortuneAlgorithm f;
+    f.set_build_diagram(true);
+    compute_into(f, sites_for(uniform, state.range(0)));
+    const std::vector<Point> qs = random_queries(1 << 14);
+    Voronoi::NeighborScratch scratch;
+    std::vector<int> out;
+    HeapCounters heap;
+    for (auto _ : state) {
+        for (const Point& q : qs) {
+            f.nearest_k(q, state.range(1), out, scratch);
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+    heap.report(state, qs.size(), "query");
+}
+
+// locate_cell through a published snapshot, one read guard per query
+void BM_snapshot_locate(benchmark::State& state) {
+    FortuneAlgorithm f;
+    compute_into(f, sites_for(uniform, state.range(0)));
+    Voronoi::SnapshotPublisher pub;
+    pub.publish(f.snapshot());
+    auto reader = pub.reader();
+    const std::vector<Point> qs = random_queries(1 << 14);
+    HeapCounters heap;
+    for (auto _ : state) {
+        for (const Point& q : qs) {
+            auto snapshot = reader.read();
+            benchmark::DoNotOptimize(snapshot->locate_cell(q));
+        }
+    }
+    heap.report(state, qs.size(), "query");
+}
+
+// Windows holding about 64 sites each, whatever the size of the whole set
+void BM_window_compute(benchmark::State& state) {
+    const std::vector<Point>& sites = sites_for(uniform, state.range(0));
+    Voronoi::WindowedDiagram wd(sites);
+    const double side = 8000.0 / std::sqrt(static_cast<double>(sites.size()));
+    const std::vector<Point> corners = random_queries(256);
+    Voronoi::WindowCells out;
+    HeapCounters heap;
+    for (auto _ : state) {
+        for (const Point& c : corners) {
+            wd.compute(c.x, c.y, c.x + side, c.y + side, out);
+            benchmark::DoNotOptimize(out.segments.data());
+        }
+    }
+    heap.report(state, corners.size(), "window");
+}
+
+// Jump-flooded labels of a 1024 x 1024 grid, against the exact ones of
+// BM_locate_cells_raster
+void BM_raster_labels(benchmark::State& state) {
+    Voronoi::RasterVoronoi raster;
+    raster.set_grid(0.0, 0.0, 1000.0, 1000.0, 1024, 1024);
+    raster.add_points(sites_for(uniform, state.range(0)));
+    HeapCounters heap;
+    for (auto _ : state) {
+        raster.compute();
+        benchmark::DoNotOptimize(raster.labels().data());
+    }
+    state.SetLabel(Voronoi::raster_isa());
+    heap.report(state, 1024 * 1024, "pixel");
+}
+
+void BM_get_segments(benchmark::State& state) {
+    FortuneAlgorithm f;
+    compute_into(f, sites_for(uniform, state.range(0)));
+    HeapCounters heap;
+    for (auto _ : state) {
+        std::vector<Voronoi::Segment> segs = f.get_segments();
+        benchmark::DoNotOptimize(segs.data());
+    }
+    heap.report(state, state.range(0), "site");
+}
+
+void BM_segments_view(benchmark::State& state) {
+    FortuneAlgorithm f;
+    compute_into(f, sites_for(uniform, state.range(0)));
+    HeapCounters heap;
+    for (auto _ : state) {
+        double sum = 0.0;
+        for (const Voronoi::Segment& s : f.segments()) sum += s.end.x;
+        benchmark::DoNotOptimize(sum);
+    }
+    heap.report(state, state.range(0), "site");
+}
+
+void sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_compute, uniform, uniform)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_compute, clustered, clustered)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_compute, grid, grid)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_compute, sorted, sorted)->Apply(sizes);
+BENCHMARK(BM_compute_reused)->RangeMultiplier(10)->Range(100, 100000);
+BENCHMARK_TEMPLATE(BM_compute_as, float)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_compute_as, std::int32_t)->Apply(sizes);
+BENCHMARK(BM_compute_weighted)->Apply(sizes);
+BENCHMARK(BM_compute_parallel)->Apply(sizes)->UseRealTime();
+BENCHMARK(BM_compute_pipelined)->Apply(sizes)->UseRealTime();
+BENCHMARK(BM_compute_batch)->RangeMultiplier(10)->Range(100, 10000)->UseRealTime();
+BENCHMARK(BM_relax)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_locate_cell)->RangeMultiplier(100)->Range(1000, 1000000);
+BENCHMARK(BM_locate_cells_raster)->RangeMultiplier(100)->Range(1000, 1000000);
+BENCHMARK(BM_nearest_k)->ArgsProduct({{1000, 1000000}, {1, 8, 64}});
+BENCHMARK(BM_snapshot_locate)->RangeMultiplier(100)->Range(1000, 1000000);
+BENCHMARK(BM_raster_labels)->RangeMultiplier(100)->Range(100, 1000000)->UseRealTime();
+BENCHMARK(BM_window_compute)->RangeMultiplier(100)->Range(10000, 1000000);
+BENCHMARK(BM_get_segments)->RangeMultiplier(100)->Range(1000, 1000000);
+BENCHMARK(BM_segments_view)->RangeMultiplier(100)->Range(1000, 1000000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,141 @@
+#include "cells.hh"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+
+namespace Voronoi {
+
+namespace {
+
+double dist2(const Point& a, const Point& b) {
+    const double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+} // namespace
+
+template <typename T>
+int CellView<T>::locate(const Point& q) const {
+    const int s = index.nearest(q);
+    // The index only knows the sites of its last build; edits since are followed on the diagram
+    return removed.empty() ? s : nearest_live(s, q);
+}
+
+template <typename T>
+void CellView<T>::locate(std::span<const Point> queries, std::span<int> out) const {
+    index.nearest(queries, out);
+    if (!removed.empty()) {
+        for (std::size_t i = 0; i < queries.size(); ++i) out[i] = nearest_live(out[i], queries[i]);
+    }
+}
+
+template <typename T>
+int CellView<T>::nearest_live(int s, const Point& q) const {
+    while (s >= 0 && removed[s]) s = moved_to[s];
+    if (s < 0) {
+        // Nowhere to start from; any live site will do
+        s = 0;
+        while (s < static_cast<int>(sites.size()) && removed[s]) ++s;
+        if (s == static_cast<int>(sites.size())) return -1;
+    }
+    // A duplicate has no cell to walk from, but the site it repeats does
+    const auto dup = std::lower_bound(duplicates.begin(), duplicates.end(), std::make_pair(s, -1));
+    if (dup != duplicates.end() && dup->first == s) s = dup->second;
+    
+    // The greedy walk cannot get stuck in a Delaunay triangulation
+    for (int from = -1; from != s;) {
+        from = s;
+        for_each_neighbor(from, [&](int t) {
+            if (dist2(q, sites[t]) < dist2(q, sites[s])) s = t;
+        });
+    }
+    return s;
+}
+
+template <typename T>
+void CellView<T>::nearest_k(const Point& q, std::size_t k, std::vector<int>& out, NeighborScratch& scratch) const {
+    neighbors(q, k, std::numeric_limits<double>::infinity(), out, scratch);
+}
+
+template <typename T>
+void CellView<T>::within_radius(const Point& q, double r, std::vector<int>& out, NeighborScratch& scratch) const {
+    out.clear();
+    if (r >= 0) neighbors(q, std::numeric_limits<std::size_t>::max(), r * r, out, scratch);
+}
+
+// The sites taken so far are the nearest ones, and the next nearest is a
+// Delaunay neighbour of one of them, so it is on the frontier: the closest
+// site there is always the next one. Sites beyond sqrt(r2) never get onto
+// the frontier, which holds at most the neighbours of the k sites taken.
+template <typename T>
+void CellView<T>::neighbors(const Point& q, std::size_t k, double r2, std::vector<int>& out, NeighborScratch& scratch) const {
+    // Built with the diagram; equal sites alone have faces but no edges
+    assert(sites.size() <= 1 || !diagram.faces.empty());
+    out.clear();
+    if (k == 0) return;
+    int s0 = locate(q);
+    if (s0 < 0) return;
+    // A duplicate has no cell to grow from, but the site it repeats does
+    const auto dup = std::lower_bound(duplicates.begin(), duplicates.end(), std::make_pair(s0, -1));
+    if (dup != duplicates.end() && dup->first == s0) {
+        s0 = dup->second;
+        if (!removed.empty()) s0 = nearest_live(s0, q);
+    }
+    if (dist2(q, sites[s0]) > r2) return;
+    
+    // A new stamp per query instead of clearing the marks
+    if (scratch.seen.size() < sites.size()) scratch.seen.resize(sites.size(), scratch.query);
+    if (++scratch.query == 0) {
+        std::fill(scratch.seen.begin(), scratch.seen.end(), 0);
+        scratch.query = 1;
+    }
+    const std::uint32_t stamp = scratch.query;
+    auto& frontier = scratch.frontier;
+    frontier.clear();
+    
+    frontier.push_back({dist2(q, sites[s0]), s0});
+    scratch.seen[s0] = stamp;
+    while (!frontier.empty()) {
+        std::pop_heap(frontier.begin(), frontier.end(), std::greater<>());
+        const int s = frontier.back().second;
+        frontier.pop_back();
+        out.push_back(s);
+        if (out.size() == k) break;
+        
+        for_each_neighbor(s, [&](int t) {
+            if (scratch.seen[t] == stamp) return;
+            scratch.seen[t] = stamp;
+            const double d = dist2(q, sites[t]);
+            if (d <= r2) {
+                frontier.push_back({d, t});
+                std::push_heap(frontier.begin(), frontier.end(), std::greater<>());
+            }
+        });
+    }
+}
+
+// The boundary of a cell is the chain from its face's half-edge, except
+// for a strip between two parallel edges (collinear sites): its chain is
+// one edge infinite both ways, and the other is only found by a scan
+template <typename T>
+template <typename Visit>
+void CellView<T>::for_each_neighbor(int s, Visit&& visit) const {
+    const int first = diagram.faces[s].half_edge;
+    for (int h = first; h >= 0;) {
+        visit(diagram.neighbor(h));
+        h = diagram.half_edges[h].next;
+        if (h == first) return;
+    }
+    if (first >= 0 && diagram.half_edges[first].origin < 0 && diagram.destination(first) < 0) {
+        for (int h = 0; h < static_cast<int>(diagram.half_edges.size()); ++h) {
+            if (h != first && diagram.half_edges[h].face == s) visit(diagram.neighbor(h));
+        }
+    }
+}
+
+template struct CellView<double>;
+template struct CellView<float>;
+template struct CellView<std::int32_t>;
+
+} // namespace Voronoi
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "diagram.hh"
+#include "point.hh"
+#include "site_index.hh"
+
+namespace Voronoi {
+
+// Working storage of the nearest_k and within_radius queries. Queries
+// passed the same scratch do not allocate once it has grown to their
+// size; concurrent queries each need their own.
+class NeighborScratch {
+    template <typename> friend struct CellView;
+    
+    std::vector<std::pair<double, int>> frontier; // Min-heap on squared distance
+    std::vector<std::uint32_t> seen;              // Per site: last query that reached it
+    std::uint32_t query = 0;
+};
+
+// The queries on a finished diagram, over storage owned by someone else:
+// BasicFortuneAlgorithm after compute() and edits, or a BasicSnapshot.
+// Everything is read-only, so any number of threads may query at once.
+template <typename T>
+struct CellView {
+    std::span<const BasicPoint<T>> sites;
+    const Diagram& diagram;
+    const SiteIndex& index;
+    std::span<const std::pair<int, int>> duplicates; // Equal sites: one without a cell, the one with it
+    std::span<const char> removed;                    // Empty until the first edit
+    std::span<const int> moved_to;                    // Removed site -> a former neighbour
+    
+    // Site whose cell contains q, -1 without sites
+    int locate(const Point& q) const;
+    void locate(std::span<const Point> queries, std::span<int> out) const;
+    // Nearest live site to q, walking the Delaunay neighbours from site s
+    int nearest_live(int s, const Point& q) const;
+    // The k sites nearest to q, and the sites within distance r of it,
+    // nearest first: see BasicFortuneAlgorithm::nearest_k
+    void nearest_k(const Point& q, std::size_t k, std::vector<int>& out, NeighborScratch& scratch) const;
+    void within_radius(const Point& q, double r, std::vector<int>& out, NeighborScratch& scratch) const;
+    // Both: sites by distance from q, up to k of them and none beyond
+    // sqrt(r2), grown best-first through the cells from locate(q)
+    void neighbors(const Point& q, std::size_t k, double r2, std::vector<int>& out, NeighborScratch& scratch) const;
+    // Calls visit with the site across each edge of the cell of s
+    template <typename Visit>
+    void for_each_neighbor(int s, Visit&& visit) const;
+};
+
+} // namespace Voronoi
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+#include "point.hh"
+
+namespace Voronoi {
+
+// Convex clip region with its corners in counterclockwise order. Segments
+// are cut parametrically against each side (Liang-Barsky, in the
+// Cyrus-Beck form that works for any convex polygon).
+class ClipPolygon {
+public:
+    ClipPolygon() = default;
+    explicit ClipPolygon(std::span<const Point> ccw) : corners(ccw.begin(), ccw.end()) {}
+    
+    static ClipPolygon rect(double x0, double y0, double x1, double y1) {
+        const Point c[4] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+        return ClipPolygon(c);
+    }
+    
+    bool empty() const { return corners.empty(); }
+    const std::vector<Point>& points() const { return corners; }
+    
+    // Shrinks a-b to its part inside the region; false if nothing is left
+    bool clip(Point& a, Point& b) const {
+        const double dx = b.x - a.x, dy = b.y - a.y;
+        // The cuts as t along a->b, and as 1 - t back from b taken from
+        // b's own side values, so each cut point is placed from the nearer
+        // end: a ray cut off far out must not cost its near end precision
+        double t0 = 0.0, t1 = 1.0, u0 = 1.0, u1 = 0.0;
+        for (std::size_t i = 0; i < corners.size(); ++i) {
+            const Point& c = corners[i];
+            const Point& d = corners[(i + 1) % corners.size()];
+            // Inside means left of c->d: side + t * rate >= 0 along a->b
+            const double side = (d.x - c.x) * (a.y - c.y) - (d.y - c.y) * (a.x - c.x);
+            const double side_b = (d.x - c.x) * (b.y - c.y) - (d.y - c.y) * (b.x - c.x);
+            const double rate = (d.x - c.x) * dy - (d.y - c.y) * dx;
+            if (rate == 0.0) {
+                if (side < 0.0) return false;
+            } else if (rate > 0.0) {
+                if (-side / rate > t0) {
+                    t0 = -side / rate;
+                    u0 = side_b / rate;
+                }
+            } else if (-side / rate < t1) {
+                t1 = -side / rate;
+                u1 = side_b / rate;
+            }
+            if (t0 > t1) return false;
+        }
+        const Point start = a, end = b;
+        auto at = [&](double t, double u) {
+            return t <= 0.5 ? Point{start.x + t * dx, start.y + t * dy} : Point{end.x - u * dx, end.y - u * dy};
+        };
+        if (t0 > 0.0) a = at(t0, u0);
+        if (t1 < 1.0) b = at(t1, u1);
+        return true;
+    }
+    
+    // Keeps the part of convex polygon poly that is closer to s than to t
+    static void cut(std::vector<Point>& poly, const Point& s, const Point& t) {
+        const double nx = t.x - s.x, ny = t.y - s.y;
+        const double m = nx * (s.x + t.x) / 2 + ny * (s.y + t.y) / 2;
+        auto side = [&](const Point& q) { return m - (nx * q.x + ny * q.y); };
+        
+        std::vector<Point> out;
+        out.reserve(poly.size() + 1);
+        for (std::size_t i = 0; i < poly.size(); ++i) {
+            const Point& p = poly[i];
+            const Point& q = poly[(i + 1) % poly.size()];
+            const double sp = side(p), sq = side(q);
+            if (sp >= 0.0) out.push_back(p);
+            if ((sp > 0.0 && sq < 0.0) || (sp < 0.0 && sq > 0.0)) {
+                const double u = sp / (sp - sq);
+                out.push_back({p.x + u * (q.x - p.x), p.y + u * (q.y - p.y)});
+            }
+        }
+        poly.swap(out);
+    }
+    
+private:
+    std::vector<Point> corners;
+};
+
+} // namespace Voronoi
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "point.hh"
+
+namespace Voronoi {
+
+// Index-based doubly-connected edge list of a Voronoi diagram. Faces are
+// indexed like the input sites and half-edges come in twin pairs 2k, 2k+1,
+// each running counterclockwise around the face on its left. Edges that go
+// off to infinity have origin -1 at their open end, and the boundary of an
+// unbounded face is the chain starting at its face.half_edge. Slots freed
+// by FortuneAlgorithm::remove_site/insert_site have face -1 (half-edges) or
+// half_edge -1 (vertices) until they are reused.
+struct Diagram {
+    struct Vertex {
+        Point p;
+        int half_edge; // One half-edge leaving the vertex, -1 if free
+    };
+    
+    struct HalfEdge {
+        int origin; // Vertex, or -1 at infinity
+        int next;   // -1 where the boundary runs off to infinity
+        int prev;
+        int face;   // -1 if free
+    };
+    
+    struct Face {
+        int half_edge; // -1 for a site without a cell (duplicates, removed)
+    };
+    
+    std::vector<Vertex> vertices;
+    std::vector<HalfEdge> half_edges;
+    std::vector<Face> faces;
+    
+    static int twin(int h) { return h ^ 1; }
+    int destination(int h) const { return half_edges[twin(h)].origin; }
+    // Site on the other side of half-edge h
+    int neighbor(int h) const { return half_edges[twin(h)].face; }
+    
+    void clear() {
+        vertices.clear();
+        half_edges.clear();
+        faces.clear();
+    }
+};
+
+} // namespace Voronoi
@@ -0,0 +1,160 @@
+#include "external.hh"
+#include "io.hh"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+namespace Voronoi {
+
+namespace {
+
+template <typename P>
+bool site_less(const P& a, const P& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// Temporary file that is removed again when it goes out of scope
+class TempFile {
+public:
+    TempFile(const std::string& dir, const char* what) {
+        static std::atomic<unsigned> serial{0};
+        const std::filesystem::path base = dir.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(dir);
+        path = (base / ("voronoi-" + std::string(what) + "-" + std::to_string(::getpid()) + "-"
+                        + std::to_string(serial++) + ".bin")).string();
+    }
+    ~TempFile() {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    
+    std::string path;
+};
+
+// Points f's edge sink at a writer for a run, and back at the caller's
+// sink when the run ends or throws; declared after the writer, so the
+// writer outlives it
+template <typename T>
+class SinkSwap {
+public:
+    SinkSwap(BasicFortuneAlgorithm<T>& f, BasicEdgeSink<T> sink) : f(f), saved(f.get_edge_sink()) {
+        f.set_edge_sink(std::move(sink));
+    }
+    ~SinkSwap() { f.set_edge_sink(std::move(saved)); }
+    SinkSwap(const SinkSwap&) = delete;
+    SinkSwap& operator=(const SinkSwap&) = delete;
+    
+private:
+    BasicFortuneAlgorithm<T>& f;
+    BasicEdgeSink<T> saved;
+};
+
+template <typename T>
+void sort_sites_as(const MappedFile& file, const std::string& out, std::size_t memory_bytes, const std::string& tmp_dir) {
+    using P = BasicPoint<T>;
+    const std::span<const P> sites = mapped_sites<T>(file);
+    const std::size_t run = std::max<std::size_t>(memory_bytes / sizeof(P), 1);
+    
+    std::vector<P> buffer;
+    if (sites.size() <= run) {
+        buffer.assign(sites.begin(), sites.end());
+        std::sort(buffer.begin(), buffer.end(), site_less<P>);
+        write_sites<T>(out, buffer);
+        return;
+    }
+    
+    // Sorted runs, each going to its own file
+    std::vector<std::unique_ptr<TempFile>> runs;
+    buffer.reserve(run);
+    for (std::size_t begin = 0; begin < sites.size(); begin += run) {
+        const std::size_t end = std::min(begin + run, sites.size());
+        buffer.assign(sites.begin() + begin, sites.begin() + end);
+        std::sort(buffer.begin(), buffer.end(), site_less<P>);
+        runs.push_back(std::make_unique<TempFile>(tmp_dir, "run"));
+        write_sites<T>(runs.back()->path, buffer);
+    }
+    buffer = {};
+    
+    // k-way merge, with the next site of every run in a heap
+    std::vector<MappedFile> maps;
+    std::vector<std::span<const P>> heads;
+    for (const auto& r : runs) {
+        maps.emplace_back(r->path);
+        heads.push_back(mapped_sites<T>(maps.back()));
+    }
+    auto later = [&heads](std::size_t i, std::size_t j) { return site_less(heads[j].front(), heads[i].front()); };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap(later);
+    for (std::size_t i = 0; i < heads.size(); ++i) heap.push(i);
+    
+    SiteFileWriter<T> writer(out);
+    while (!heap.empty()) {
+        const std::size_t i = heap.top();
+        heap.pop();
+        writer.add(heads[i].front());
+        heads[i] = heads[i].subspan(1);
+        if (!heads[i].empty()) heap.push(i);
+    }
+    writer.close();
+}
+
+} // namespace
+
+void sort_site_file(const std::string& in, const std::string& out, std::size_t memory_bytes, const std::string& tmp_dir) {
+    const MappedFile file(in);
+    switch (static_cast<CoordType>(file.header().coord)) {
+    case CoordType::f64: sort_sites_as<double>(file, out, memory_bytes, tmp_dir); break;
+    case CoordType::f32: sort_sites_as<float>(file, out, memory_bytes, tmp_dir); break;
+    case CoordType::i32: sort_sites_as<std::int32_t>(file, out, memory_bytes, tmp_dir); break;
+    default: throw std::runtime_error("unknown coordinate type in " + in);
+    }
+}
+
+template <typename T>
+void compute_out_of_core(BasicFortuneAlgorithm<T>& f, const std::string& sites_path, const std::string& segments_path,
+                         std::size_t memory_bytes, const std::string& tmp_dir) {
+    using P = BasicPoint<T>;
+    const MappedFile input(sites_path);
+    std::span<const P> sorted = mapped_sites<T>(input);
+    
+    std::optional<TempFile> sorted_file;
+    std::optional<MappedFile> sorted_map;
+    if (!std::is_sorted(sorted.begin(), sorted.end(), site_less<P>)) {
+        sorted_file.emplace(tmp_dir, "sorted");
+        sort_site_file(sites_path, sorted_file->path, memory_bytes, tmp_dir);
+        sorted_map.emplace(sorted_file->path);
+        sorted = mapped_sites<T>(*sorted_map);
+    }
+    
+    ChunkedSegmentWriter<T> writer(segments_path);
+    SinkSwap<T> swap(f, writer.sink());
+    f.compute_stream(sorted);
+    writer.close();
+}
+
+template void compute_out_of_core(FortuneAlgorithm&, const std::string&, const std::string&, std::size_t, const std::string&);
+template void compute_out_of_core(FortuneAlgorithmF&, const std::string&, const std::string&, std::size_t, const std::string&);
+template void compute_out_of_core(FortuneAlgorithmI&, const std::string&, const std::string&, std::size_t, const std::string&);
+
+template <typename T>
+void compute_file_pipelined(BasicFortuneAlgorithm<T>& f, const std::string& sites_path, const std::string& segments_path,
+                            unsigned threads) {
+    const MappedFile input(sites_path);
+    ChunkedSegmentWriter<T> writer(segments_path);
+    SinkSwap<T> swap(f, writer.sink());
+    f.compute_pipelined(mapped_sites<T>(input), threads);
+    writer.close();
+}
+
+template void compute_file_pipelined(FortuneAlgorithm&, const std::string&, const std::string&, unsigned);
+template void compute_file_pipelined(FortuneAlgorithmF&, const std::string&, const std::string&, unsigned);
+template void compute_file_pipelined(FortuneAlgorithmI&, const std::string&, const std::string&, unsigned);
+
+} // namespace Voronoi
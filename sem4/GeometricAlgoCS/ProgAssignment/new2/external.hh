@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <thread>
+
+#include "voronoi.hh"
+
+namespace Voronoi {
+
+// Out-of-core runs for site sets larger than memory. Sites live in files
+// in the binary format of io.hh: an external merge sort puts them in sweep
+// order, and compute_stream() sweeps the mapped result while the segments
+// are spilled to a segment-chunks file as they finish. Temporary files go
+// to tmp_dir, or the system's temporary directory if it is empty.
+
+// Sorts the site file in by x, then y, into out. Runs of up to
+// memory_bytes worth of sites are sorted in memory and then merged.
+void sort_site_file(const std::string& in, const std::string& out,
+                    std::size_t memory_bytes = std::size_t(1) << 30, const std::string& tmp_dir = {});
+
+// The whole pipeline, with f's settings (clip region) and f's coordinate
+// type, which has to match the file. Sorted input is swept in place.
+template <typename T>
+void compute_out_of_core(BasicFortuneAlgorithm<T>& f, const std::string& sites_path, const std::string& segments_path,
+                         std::size_t memory_bytes = std::size_t(1) << 30, const std::string& tmp_dir = {});
+
+// A site file that fits in memory, swept by compute_pipelined() straight
+// from the mapping on up to threads threads, with segments spilled as above
+template <typename T>
+void compute_file_pipelined(BasicFortuneAlgorithm<T>& f, const std::string& sites_path, const std::string& segments_path,
+                            unsigned threads = std::thread::hardware_concurrency());
+
+} // namespace Voronoi
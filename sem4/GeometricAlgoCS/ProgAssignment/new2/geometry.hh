@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "point.hh"
+#include "predicates.hh"
+
+namespace Voronoi {
+
+// The two geometries BasicFortuneAlgorithm is built for, Euclidean and
+// AdditiveWeights. Each says where a site enters the sweep, where the arcs
+// of two sites meet, when an arc closes and which way an edge leaves at
+// infinity; the sweep, the queue, the pools and the output are shared.
+// Sites are passed as position plus index, so weights live here. This is
+// not a general extension point: the sweep relies on every nonempty cell
+// containing its own site, so that a site meets the beach line at its
+// entry event. Power diagrams break that (a small circle inside a large
+// one still has a cell, away from its centre) and are not supported.
+//
+//   double key(p, s)                       sweep position at which s enters
+//   double arc_x(p, s, y, l)               its arc at height y, sweep at l
+//   double breakpoint(p0, s0, p1, s1, l)   height where the arcs of s0 (below)
+//                                          and s1 meet; arc_x gives the rest
+//   bool circle<T>(a, sa, b, sb, c, sc, x, o)
+//                                          vertex o where b's arc closes, at
+//                                          sweep position x; false if never
+//   Point asymptote(a, sa, b, sb)          far direction of the edge between
+//                                          a (below) and b once the sweep ends
+
+// Orientation of three sites; integer sites take the exact integer test
+template <typename T>
+double site_orientation(const Point& a, const Point& b, const Point& c) {
+    if constexpr (std::is_integral_v<T>) {
+        return orient2d(BasicPoint<T>(a), BasicPoint<T>(b), BasicPoint<T>(c));
+    } else {
+        return orient2d(a, b, c);
+    }
+}
+
+// The ordinary diagram: every arc is the parabola with the site as focus
+// and the sweep line as directrix
+struct Euclidean {
+    static constexpr bool weighted = false;
+    
+    double key(const Point& p, int) const { return p.x; }
+    
+    static double arc_x(const Point& p, int, double y, double l) {
+        const double dx = p.x - l;
+        const double dy = p.y - y;
+        return l + (dx * dx + dy * dy) / (2 * dx);
+    }
+    
+    static double breakpoint(const Point& p0, int, const Point& p1, int, double l) {
+        if (p0.x == p1.x) return (p0.y + p1.y) / 2;
+        if (p1.x == l) return p1.y;
+        if (p0.x == l) return p0.y;
+        
+        // Use quadratic formula, in coordinates relative to the sweep line
+        // and to p0 so large coordinates do not cancel
+        const double x0 = p0.x - l;
+        const double x1 = p1.x - l;
+        const double d = p1.y - p0.y;
+        
+        const double a = x1 - x0;
+        const double b = 2 * x0 * d;
+        const double c = x0 * (x1 * (x0 - x1) - d * d);
+        
+        // The root wanted is (-b - sqrt(D)) / 2a; the second form equals it
+        // and avoids the cancellation the first has for b < 0. Rounding can
+        // push D just below zero where the parabolas touch.
+        const double root = std::sqrt(std::max(0.0, b*b - 4*a*c));
+        return p0.y + (b >= 0 ? (-b - root) / (2*a) : (2*c) / (-b + root));
+    }
+    
+    template <typename T>
+    bool circle(const Point& a, int, const Point& b, int, const Point& c, int, double* x, Point* o) const {
+        // Check that bc is a "right turn" from ab. The sign is exact, which also
+        // rules out collinear points.
+        const double det = site_orientation<T>(a, b, c);
+        if (det >= 0) {
+            return false;
+        }
+        
+        // Centre relative to a (O'Rourke 2ed p. 189, translated), which keeps
+        // the products small
+        const double A = b.x - a.x;
+        const double B = b.y - a.y;
+        const double C = c.x - a.x;
+        const double D = c.y - a.y;
+        const double E = A * A + B * B;
+        const double F = C * C + D * D;
+        const double G = 2 * det;
+        
+        // Point o is the center of the circle
+        const double ux = (D * E - B * F) / G;
+        const double uy = (A * F - C * E) / G;
+        o->x = a.x + ux;
+        o->y = a.y + uy;
+        
+        // o.x plus radius equals max x coordinate
+        *x = o->x + std::hypot(ux, uy);
+        return true;
+    }
+    
+    // Along the bisector, lower arc on its right
+    Point asymptote(const Point& a, int, const Point& b, int) const {
+        return {b.y - a.y, a.x - b.x};
+    }
+};
+
+// Additively weighted (Apollonius) diagram: the distance from q to site s
+// is |q - s| - w_s, so sites act as circles of radius w_s. Under Fortune's
+// transformation the arc of s is the parabola with focus s whose directrix
+// runs w_s ahead of the sweep line, and s enters when that directrix
+// reaches it. Edges are branches of hyperbolas; segments join their ends
+// (the vertices are exact) and run off along the asymptotes. A site whose
+// circle lies inside another one has no cell. Plain floating point
+// throughout, unlike the exact tests of Euclidean.
+struct AdditiveWeights {
+    static constexpr bool weighted = true;
+    
+    std::vector<double> weights; // Per site, in insertion order
+    
+    double key(const Point& p, int s) const { return p.x - weights[s]; }
+    
+    double arc_x(const Point& p, int s, double y, double l) const {
+        return Euclidean::arc_x(p, s, y, l + weights[s]);
+    }
+    
+    double breakpoint(const Point& p0, int s0, const Point& p1, int s1, double l) const {
+        // Focus to directrix of either parabola
+        const double k0 = l + weights[s0] - p0.x;
+        const double k1 = l + weights[s1] - p1.x;
+        const double d = p1.y - p0.y;
+        
+        if (k1 == 0) return p1.y;
+        if (k0 == 0) return p0.y;
+        if (k0 == k1) {
+            // Congruent parabolas meet once
+            return d == 0 ? p0.y : p0.y + d / 2 + k1 * (weights[s0] - weights[s1]) / d;
+        }
+        // The quadratic of Euclidean, whose c picks up the weights
+        const double a = k0 - k1;
+        const double b = -2 * k0 * d;
+        const double c = k0 * d * d + k0 * k1 * (k1 - k0 + 2 * (weights[s0] - weights[s1]));
+        const double root = std::sqrt(std::max(0.0, b*b - 4*a*c));
+        return p0.y + (b >= 0 ? (-b - root) / (2*a) : (2*c) / (-b + root));
+    }
+    
+    template <typename T>
+    bool circle(const Point& a, int sa, const Point& b, int sb, const Point& c, int sc, double* x, Point* o) const {
+        // The centre u (relative to a) and distance r with |u - p| = r + w_p
+        // for all three: subtracting the equation of a from the other two
+        // leaves two planes in (u, r), which meet in the line X0 + tN, and
+        // the equation of a is then a quadratic in t
+        const double wa = weights[sa], wb = weights[sb], wc = weights[sc];
+        const double bx = b.x - a.x, by = b.y - a.y, db = wb - wa;
+        const double cx = c.x - a.x, cy = c.y - a.y, dc = wc - wa;
+        const double hb = (bx * bx + by * by - db * (wb + wa)) / 2;
+        const double hc = (cx * cx + cy * cy - dc * (wc + wa)) / 2;
+        
+        const double nx = by * dc - db * cy, ny = db * cx - bx * dc, nz = bx * cy - by * cx;
+        const double nn = nx * nx + ny * ny + nz * nz;
+        if (nn == 0) return false;
+        const double x0 = (hb * (cy * nz - dc * ny) + hc * (ny * db - nz * by)) / nn;
+        const double y0 = (hb * (dc * nx - cx * nz) + hc * (nz * bx - nx * db)) / nn;
+        const double r0 = (hb * (cx * ny - cy * nx) + hc * (nx * by - ny * bx)) / nn;
+        
+        const double qa = nx * nx + ny * ny - nz * nz;
+        const double qb = 2 * (x0 * nx + y0 * ny - (r0 + wa) * nz);
+        const double qc = x0 * x0 + y0 * y0 - (r0 + wa) * (r0 + wa);
+        double ts[2];
+        int roots = 0;
+        if (qa == 0) {
+            if (qb != 0) ts[roots++] = -qc / qb;
+        } else {
+            const double disc = qb * qb - 4 * qa * qc;
+            if (disc < 0) return false;
+            const double q = -(qb + std::copysign(std::sqrt(disc), qb)) / 2;
+            ts[roots++] = q / qa;
+            if (q != 0) ts[roots++] = qc / q;
+        }
+        
+        // A circle closes b's arc if, going clockwise from where it touches
+        // the sweep line, it touches a, b and c in that order. Orientation
+        // alone does not do here: unlike in Euclidean, a, b, c, a on the
+        // beach line can have a vertex for either middle arc.
+        bool found = false;
+        for (int k = 0; k < roots; ++k) {
+            const double ux = x0 + ts[k] * nx, uy = y0 + ts[k] * ny, r = r0 + ts[k] * nz;
+            const double ra = r + wa, rb = r + wb, rc = r + wc;
+            if (!(ra > 0 && rb > 0 && rc > 0)) continue;
+            const double ta = clockwise(-ux / ra, -uy / ra);
+            const double tb = clockwise((bx - ux) / rb, (by - uy) / rb);
+            const double tc = clockwise((cx - ux) / rc, (cy - uy) / rc);
+            if (!(ta < tb && tb < tc)) continue;
+            const double event = a.x + ux + r;
+            if (!found || event < *x) {
+                *x = event;
+                *o = {a.x + ux, a.y + uy};
+                found = true;
+            }
+        }
+        return found;
+    }
+    
+    // Monotone in the clockwise angle of the unit vector (x, y) from (1, 0)
+    static double clockwise(double x, double y) {
+        return y <= 0 ? 1 - x : 3 + x;
+    }
+    
+    // u with u.(b - a) = w_a - w_b, on the side of the unweighted bisector
+    Point asymptote(const Point& a, int sa, const Point& b, int sb) const {
+        const double ex = b.x - a.x, ey = b.y - a.y;
+        const double len = std::hypot(ex, ey);
+        const double cos = std::clamp((weights[sa] - weights[sb]) / len, -1.0, 1.0);
+        const double sin = std::sqrt(1 - cos * cos);
+        return {(cos * ex + sin * ey) / len, (cos * ey - sin * ex) / len};
+    }
+};
+
+} // namespace Voronoi
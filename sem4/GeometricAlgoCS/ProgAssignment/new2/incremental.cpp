@@ -0,0 +1,557 @@
+#include "voronoi.hh"
+#include "predicates.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Voronoi {
+
+namespace {
+
+double dist2(const Point& a, const Point& b) {
+    const double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+template <typename T>
+bool contains(const std::vector<T>& v, T x) {
+    return std::find(v.begin(), v.end(), x) != v.end();
+}
+
+// Calls visit for the half-edges of face f in order, for a closed boundary
+// as well as for an open chain
+template <typename F>
+void for_each_half_edge(const Diagram& d, int f, F&& visit) {
+    const int first = d.faces[f].half_edge;
+    for (int h = first; h >= 0;) {
+        visit(h);
+        h = d.half_edges[h].next;
+        if (h == first) break;
+    }
+}
+
+// The three half-edges leaving vertex v
+void leaving(const Diagram& d, int v, int out[3]) {
+    int h = d.vertices[v].half_edge;
+    for (int j = 0; j < 3; ++j) {
+        out[j] = h;
+        h = d.half_edges[Diagram::twin(h)].next;
+    }
+}
+
+// Direction of half-edge h along the bisector of its two sites
+template <typename P>
+Point direction(const Diagram& d, const std::vector<P>& sites, int h) {
+    const Point a = sites[d.half_edges[h].face];
+    const Point b = sites[d.neighbor(h)];
+    return {a.y - b.y, b.x - a.x};
+}
+
+} // namespace
+
+// Edits keep the diagram consistent with the set of live sites. The sweep
+// is only rerun over the handful of sites around the edit, and the part of
+// that local diagram which the edit changes is spliced into the global one.
+// If the local result does not fit (degenerate input), the whole diagram is
+// rebuilt from the live sites instead.
+
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::insert_site(const Site& p) requires (!Geometry::weighted) {
+    assert(build_diagram);
+    begin_edit();
+    const int s0 = cells().nearest_live(site_index.nearest(p), p);
+    if (s0 >= 0 && sites[s0] == p) return s0;
+    
+    const int s = static_cast<int>(sites.size());
+    sites.push_back(p);
+    removed.push_back(0);
+    moved_to.push_back(-1);
+    diagram.faces.push_back({-1});
+    
+    if (s0 < 0 || !splice_insert(s, s0)) rebuild_diagram();
+    end_edit();
+    return renumbered.empty() ? s : renumbered[s];
+}
+
+template <typename T, typename Geometry>
+bool BasicFortuneAlgorithm<T, Geometry>::remove_site(int s) requires (!Geometry::weighted) {
+    assert(build_diagram);
+    if (s < 0 || s >= static_cast<int>(sites.size())) return false;
+    begin_edit();
+    if (removed[s]) return false;
+    removed[s] = 1;
+    take_cell(s);
+    end_edit();
+    return true;
+}
+
+// Gives the cell of the removed site s to the sites around it
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::take_cell(int s) {
+    // Of equal sites one has the cell: a duplicate has none to give away,
+    // and the cell stays with a live duplicate when its owner goes
+    const auto same = [s](const std::pair<int, int>& d) { return d.first == s; };
+    const auto dup = std::find_if(duplicates.begin(), duplicates.end(), same);
+    if (dup != duplicates.end()) {
+        moved_to[s] = dup->second;
+        duplicates.erase(dup);
+        return;
+    }
+    int heir = -1;
+    for (const auto& [d, owner] : duplicates) {
+        if (owner == s && !removed[d]) heir = d;
+    }
+    if (heir >= 0) {
+        give_cell(s, heir);
+        return;
+    }
+    
+    const int first = diagram.faces[s].half_edge;
+    if (first < 0) return;
+    moved_to[s] = diagram.neighbor(first);
+    if (!splice_remove(s)) rebuild_diagram();
+}
+
+// Hands the cell of s to the equal site to, which takes over as the owner
+// of the other duplicates
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::give_cell(int s, int to) {
+    for_each_half_edge(diagram, s, [&](int h) { diagram.half_edges[h].face = to; });
+    diagram.faces[to] = diagram.faces[s];
+    diagram.faces[s].half_edge = -1;
+    moved_to[s] = to;
+    std::erase(duplicates, std::make_pair(to, s));
+    for (auto& d : duplicates) {
+        if (d.second == s) d.second = to;
+    }
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::begin_edit() {
+    renumbered.clear();
+    if (removed.size() < sites.size()) {
+        removed.resize(sites.size(), 0);
+        moved_to.resize(sites.size(), -1);
+    }
+}
+
+// The index only knows the sites of its last build, and queries walk the
+// diagram from there, further the more edits went by; removed sites keep
+// their slots meanwhile. Compacting after a quarter of the sites' worth of
+// edits bounds both, at O(log n) per edit.
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::end_edit() {
+    if (++edits_since_index > sites.size() / 4) compact_sites();
+}
+
+// Drops the removed sites and their empty faces, numbers the live ones
+// afresh in the same order and indexes them
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::compact_sites() {
+    renumbered.assign(sites.size(), -1);
+    int n = 0;
+    for (std::size_t i = 0; i < sites.size(); ++i) {
+        if (removed[i]) continue;
+        renumbered[i] = n;
+        sites[n] = sites[i];
+        diagram.faces[n] = diagram.faces[i];
+        ++n;
+    }
+    sites.resize(n);
+    diagram.faces.resize(n);
+    for (Diagram::HalfEdge& h : diagram.half_edges) {
+        if (h.face < 0) continue;
+        assert(renumbered[h.face] >= 0);
+        h.face = renumbered[h.face];
+    }
+    // Only live sites are duplicates, and renumbering keeps them sorted
+    for (auto& [d, owner] : duplicates) {
+        d = renumbered[d];
+        owner = renumbered[owner];
+    }
+    removed.clear();
+    moved_to.clear();
+    edits_since_index = 0;
+    if (build_index) site_index.build<T>(sites);
+}
+
+// Sweeps the given sites on their own, on a sweep kept for the next edit
+// so a small one does not allocate
+template <typename T, typename Geometry>
+const Diagram& BasicFortuneAlgorithm<T, Geometry>::local_diagram(std::span<const std::uint32_t> ids) {
+    if (!edit_sweep) {
+        edit_sweep = std::make_unique<BasicFortuneAlgorithm>();
+        edit_sweep->build_index = false;
+        edit_sweep->set_build_diagram(true);
+        edit_sweep->set_edge_sink([](const Segment&) {});
+    }
+    BasicFortuneAlgorithm& sub = *edit_sweep;
+    sub.reset();
+    for (std::uint32_t i : ids) sub.add_point(sites[i]);
+    sub.compute();
+    return sub.diagram;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::rebuild_diagram() {
+    std::vector<std::uint32_t> live;
+    for (std::uint32_t i = 0; i < sites.size(); ++i) {
+        if (!removed[i]) live.push_back(i);
+    }
+    local_diagram(live);
+    // The whole diagram is replaced, so the sweep's storage goes with it
+    Diagram local = std::move(edit_sweep->diagram);
+    
+    for (Diagram::HalfEdge& he : local.half_edges) he.face = live[he.face];
+    diagram.vertices = std::move(local.vertices);
+    diagram.half_edges = std::move(local.half_edges);
+    diagram.faces.assign(sites.size(), {-1});
+    for (std::size_t f = 0; f < live.size(); ++f) diagram.faces[live[f]] = local.faces[f];
+    free_vertices.clear();
+    free_edges.clear();
+    // The sweep may have given the cell of equal sites to another of them.
+    // Its duplicates are taken over: the order of the last compute() has
+    // neither the inserted sites nor the removals.
+    duplicates.clear();
+    for (const auto& [d, owner] : edit_sweep->duplicates) {
+        duplicates.push_back({static_cast<int>(live[d]), static_cast<int>(live[owner])});
+    }
+}
+
+template <typename T, typename Geometry>
+bool BasicFortuneAlgorithm<T, Geometry>::splice_insert(int s, int s0) {
+    const Point p = sites[s];
+    auto origin = [this](int h) { return diagram.half_edges[h].origin; };
+    auto face = [this](int h) { return diagram.half_edges[h].face; };
+    
+    // Vertices and rays that end up inside the new cell: a vertex whose
+    // circle holds p, and a ray (kept as the half-edge leaving its finite
+    // end) that heads towards p rather than away from it
+    auto closer = [&](int v) {
+        int out[3];
+        leaving(diagram, v, out);
+        const Point& a = sites[face(out[0])];
+        const Point& b = sites[face(out[1])];
+        const Point& c = sites[face(out[2])];
+        const double inside = incircle(a, b, c, p);
+        return orient2d(a, b, c) > 0 ? inside > 0 : inside < 0;
+    };
+    auto heads_to = [&](int h) {
+        return orient2d(sites[face(h)], sites[diagram.neighbor(h)], p) > 0.0;
+    };
+    
+    std::vector<int> seen, gone, vertex_stack;
+    std::vector<int> seen_rays, gone_rays, ray_stack;
+    bool line = false;
+    auto visit_vertex = [&](int v) {
+        if (contains(seen, v)) return;
+        seen.push_back(v);
+        if (closer(v)) {
+            gone.push_back(v);
+            vertex_stack.push_back(v);
+        }
+    };
+    auto visit_ray = [&](int edge) {
+        const int h = 2 * edge + (origin(2 * edge) < 0);
+        if (origin(h) < 0) {
+            line = true; // An edge without vertices, only in collinear input
+            return;
+        }
+        if (contains(seen_rays, h)) return;
+        seen_rays.push_back(h);
+        if (heads_to(h)) {
+            gone_rays.push_back(h);
+            ray_stack.push_back(h);
+        }
+    };
+    auto visit_rays = [&](int f) {
+        for_each_half_edge(diagram, f, [&](int h) {
+            if (origin(h) < 0 || diagram.destination(h) < 0) visit_ray(h / 2);
+        });
+    };
+    
+    // The conflict region is connected and touches the cell containing p
+    for_each_half_edge(diagram, s0, [&](int h) {
+        if (origin(h) >= 0) visit_vertex(origin(h));
+    });
+    visit_rays(s0);
+    while (!vertex_stack.empty() || !ray_stack.empty()) {
+        if (!vertex_stack.empty()) {
+            const int v = vertex_stack.back();
+            vertex_stack.pop_back();
+            int out[3];
+            leaving(diagram, v, out);
+            for (int h : out) {
+                const int w = diagram.destination(h);
+                if (w >= 0) {
+                    visit_vertex(w);
+                } else {
+                    visit_ray(h / 2);
+                }
+            }
+        } else {
+            // Along the hull, rays follow each other through unbounded faces
+            const int h = ray_stack.back();
+            ray_stack.pop_back();
+            visit_vertex(origin(h));
+            visit_rays(face(h));
+            visit_rays(diagram.neighbor(h));
+        }
+    }
+    if (line || (gone.empty() && gone_rays.empty())) return false;
+    
+    // Edges the new cell swallows, and edges it cuts; a cut is the
+    // half-edge whose origin moves onto the boundary of the new cell
+    std::vector<int> dead_edges, cuts;
+    for (int v : gone) {
+        int out[3];
+        leaving(diagram, v, out);
+        for (int h : out) {
+            const int w = diagram.destination(h);
+            if (w >= 0 ? contains(gone, w) : contains(gone_rays, h)) {
+                if (!contains(dead_edges, h / 2)) dead_edges.push_back(h / 2);
+            } else {
+                cuts.push_back(h);
+            }
+        }
+    }
+    for (int h : gone_rays) {
+        if (!contains(gone, origin(h))) cuts.push_back(Diagram::twin(h));
+    }
+    
+    // The new cell only depends on its neighbours, the sites of the cuts
+    std::vector<std::uint32_t> ids{static_cast<std::uint32_t>(s)};
+    for (int h : cuts) {
+        for (int f : {face(h), diagram.neighbor(h)}) {
+            if (!contains(ids, static_cast<std::uint32_t>(f))) ids.push_back(f);
+        }
+    }
+    const Diagram& local = local_diagram(ids);
+    
+    std::vector<int> cell;
+    for_each_half_edge(local, 0, [&](int h) { cell.push_back(h); });
+    
+    // Each vertex of the local cell lies on one cut edge
+    const int n = static_cast<int>(cell.size());
+    std::vector<int> cut_of(n, -1);
+    int matched = 0;
+    for (int i = 0; i < n; ++i) {
+        const Diagram::HalfEdge& hl = local.half_edges[cell[i]];
+        if (hl.origin < 0) continue;
+        const int before = cell[(i + n - 1) % n];
+        if (hl.prev != before) return false;
+        const int a = ids[local.neighbor(cell[i])];
+        const int b = ids[local.neighbor(before)];
+        for (int c : cuts) {
+            const int f = face(c), g = diagram.neighbor(c);
+            if ((f == a && g == b) || (f == b && g == a)) {
+                if (contains(cut_of, c)) return false;
+                cut_of[i] = c;
+            }
+        }
+        if (cut_of[i] < 0) return false;
+        ++matched;
+    }
+    if (matched != static_cast<int>(cuts.size())) return false;
+    
+    // Splice: drop what the cell swallowed, then add the cell
+    for (int v : gone) delete_vertex(v);
+    for (int edge : dead_edges) delete_edge(edge);
+    
+    std::vector<int> to_global(local.vertices.size(), -1);
+    for (int i = 0; i < n; ++i) {
+        const int lv = local.half_edges[cell[i]].origin;
+        if (lv >= 0) to_global[lv] = new_vertex(local.vertices[lv].p, -1);
+    }
+    std::vector<int> edges(n);
+    for (int i = 0; i < n; ++i) edges[i] = new_edge(s, ids[local.neighbor(cell[i])]);
+    for (int i = 0; i < n; ++i) {
+        const int lv = local.half_edges[cell[i]].origin;
+        if (lv < 0) continue;
+        const int out[3] = {cut_of[i], 2 * edges[i], 2 * edges[(i + n - 1) % n] + 1};
+        link_vertex(to_global[lv], out);
+    }
+    for (int edge : edges) {
+        fix_face(2 * edge);
+        fix_face(2 * edge + 1);
+    }
+    return true;
+}
+
+template <typename T, typename Geometry>
+bool BasicFortuneAlgorithm<T, Geometry>::splice_remove(int s) {
+    auto origin = [this](int h) { return diagram.half_edges[h].origin; };
+    auto face = [this](int h) { return diagram.half_edges[h].face; };
+    
+    // The cell of s with its vertices, and the edges between two
+    // neighbours that end on it
+    std::vector<int> own, gone, cuts;
+    std::vector<std::uint32_t> ids;
+    for_each_half_edge(diagram, s, [&](int h) {
+        own.push_back(h);
+        const std::uint32_t t = diagram.neighbor(h);
+        if (!contains(ids, t)) ids.push_back(t);
+        for (int v : {origin(h), diagram.destination(h)}) {
+            if (v >= 0 && !contains(gone, v)) gone.push_back(v);
+        }
+    });
+    for (int v : gone) {
+        int out[3];
+        leaving(diagram, v, out);
+        for (int h : out) {
+            if (face(h) != s && diagram.neighbor(h) != s) cuts.push_back(h);
+        }
+    }
+    // A cell without vertices is a half-plane or a strip (collinear
+    // sites), and the edge its neighbours get has nothing to hang on
+    if (gone.empty() || cuts.size() != gone.size()) return false;
+    
+    // The neighbours' diagram inside the old cell is the new one there
+    const Diagram& local = local_diagram(ids);
+    std::vector<char> fresh(local.vertices.size());
+    for (std::size_t v = 0; v < fresh.size(); ++v) {
+        const Diagram::Vertex& x = local.vertices[v];
+        fresh[v] = dist2(x.p, sites[s]) < dist2(x.p, sites[ids[local.half_edges[x.half_edge].face]]);
+    }
+    auto local_face = [&](int f) {
+        return static_cast<int>(std::find(ids.begin(), ids.end(), static_cast<std::uint32_t>(f)) - ids.begin());
+    };
+    
+    // A cut edge continues along the same local edge to its new end
+    std::vector<int> cut_origin(cuts.size(), -1);
+    std::vector<int> count(local.vertices.size(), 0);
+    for (std::size_t i = 0; i < cuts.size(); ++i) {
+        const int b = diagram.neighbor(cuts[i]);
+        int lh = -1;
+        for_each_half_edge(local, local_face(face(cuts[i])), [&](int h) {
+            if (static_cast<int>(ids[local.neighbor(h)]) == b) lh = h;
+        });
+        if (lh < 0) return false;
+        const int lo = local.half_edges[lh].origin;
+        if (lo >= 0 && !fresh[lo]) return false;
+        cut_origin[i] = lo;
+        if (lo >= 0) ++count[lo];
+    }
+    
+    // Local edges that reach into the old cell and are not cut edges are new
+    std::vector<int> added;
+    for (int k = 0; k < static_cast<int>(local.half_edges.size() / 2); ++k) {
+        const int o0 = local.half_edges[2 * k].origin, o1 = local.half_edges[2 * k + 1].origin;
+        if (!(o0 >= 0 && fresh[o0]) && !(o1 >= 0 && fresh[o1])) continue;
+        const int a = ids[local.half_edges[2 * k].face], b = ids[local.half_edges[2 * k + 1].face];
+        bool cut = false;
+        for (int c : cuts) cut |= (face(c) == a && diagram.neighbor(c) == b) || (face(c) == b && diagram.neighbor(c) == a);
+        if (cut) continue;
+        if ((o0 >= 0 && !fresh[o0]) || (o1 >= 0 && !fresh[o1])) return false;
+        added.push_back(k);
+        if (o0 >= 0) ++count[o0];
+        if (o1 >= 0) ++count[o1];
+    }
+    for (std::size_t v = 0; v < fresh.size(); ++v) {
+        if (fresh[v] && count[v] != 3) return false;
+    }
+    
+    // Splice: the cell goes, its neighbours grow into it
+    for (int h : own) delete_edge(h / 2);
+    for (int v : gone) delete_vertex(v);
+    diagram.faces[s].half_edge = -1;
+    
+    std::vector<int> to_global(local.vertices.size(), -1);
+    std::vector<int> out(3 * local.vertices.size());
+    std::fill(count.begin(), count.end(), 0);
+    for (std::size_t v = 0; v < fresh.size(); ++v) {
+        if (fresh[v]) to_global[v] = new_vertex(local.vertices[v].p, -1);
+    }
+    for (std::size_t i = 0; i < cuts.size(); ++i) {
+        const int h = cuts[i], lo = cut_origin[i];
+        if (lo >= 0) {
+            out[3 * lo + count[lo]++] = h;
+        } else {
+            // Now runs off to infinity through the old cell
+            diagram.half_edges[h].origin = -1;
+            diagram.half_edges[h].prev = -1;
+            diagram.half_edges[Diagram::twin(h)].next = -1;
+        }
+    }
+    std::vector<int> edges;
+    for (int k : added) {
+        const int edge = new_edge(ids[local.half_edges[2 * k].face], ids[local.half_edges[2 * k + 1].face]);
+        edges.push_back(edge);
+        for (int j = 0; j < 2; ++j) {
+            const int lo = local.half_edges[2 * k + j].origin;
+            if (lo >= 0) out[3 * lo + count[lo]++] = 2 * edge + j;
+        }
+    }
+    for (std::size_t v = 0; v < fresh.size(); ++v) {
+        if (fresh[v]) link_vertex(to_global[v], &out[3 * v]);
+    }
+    
+    for (int h : cuts) {
+        fix_face(h);
+        fix_face(Diagram::twin(h));
+    }
+    for (int edge : edges) {
+        fix_face(2 * edge);
+        fix_face(2 * edge + 1);
+    }
+    return true;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::delete_vertex(int v) {
+    diagram.vertices[v].half_edge = -1;
+    free_vertices.push_back(v);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::delete_edge(int edge) {
+    diagram.half_edges[2 * edge] = diagram.half_edges[2 * edge + 1] = {-1, -1, -1, -1};
+    free_edges.push_back(edge);
+}
+
+// Makes v the origin of the given half-edges and links the faces around it
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::link_vertex(int v, const int leaving[3]) {
+    int e[3];
+    double angle[3];
+    for (int j = 0; j < 3; ++j) {
+        const Point d = direction(diagram, sites, leaving[j]);
+        e[j] = leaving[j];
+        angle[j] = std::atan2(d.y, d.x);
+    }
+    // Counterclockwise order
+    for (int j = 0; j < 3; ++j) {
+        for (int k = j + 1; k < 3; ++k) {
+            if (angle[k] < angle[j]) {
+                std::swap(angle[j], angle[k]);
+                std::swap(e[j], e[k]);
+            }
+        }
+    }
+    // The face between two leaving half-edges enters v on the twin of the later one
+    for (int j = 0; j < 3; ++j) {
+        diagram.half_edges[e[j]].origin = v;
+        link(Diagram::twin(e[(j + 1) % 3]), e[j]);
+    }
+    diagram.vertices[v].half_edge = e[0];
+}
+
+// Points the face of h at its boundary again, at the open end of a chain
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::fix_face(int h) {
+    const int start = h;
+    while (diagram.half_edges[h].prev >= 0) {
+        h = diagram.half_edges[h].prev;
+        if (h == start) break;
+    }
+    diagram.faces[diagram.half_edges[h].face].half_edge = h;
+}
+
+template int BasicFortuneAlgorithm<double>::insert_site(const Point&);
+template int BasicFortuneAlgorithm<float>::insert_site(const PointF&);
+template int BasicFortuneAlgorithm<std::int32_t>::insert_site(const PointI&);
+template bool BasicFortuneAlgorithm<double>::remove_site(int);
+template bool BasicFortuneAlgorithm<float>::remove_site(int);
+template bool BasicFortuneAlgorithm<std::int32_t>::remove_site(int);
+
+} // namespace Voronoi
@@ -0,0 +1,373 @@
+#include "io.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Voronoi {
+
+namespace {
+
+constexpr char magic[8] = "VORONOI";
+constexpr std::uint32_t byte_order = 0x01020304;
+constexpr std::uint32_t version = 1;
+constexpr std::uint64_t unknown_count = ~std::uint64_t(0);
+
+static_assert(sizeof(Diagram::Vertex) == 24 && sizeof(Diagram::HalfEdge) == 16 && sizeof(Diagram::Face) == 4,
+              "diagram files store the structs as they are");
+
+[[noreturn]] void fail(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+FileHeader make_header(FileKind kind, CoordType coord, std::uint64_t count) {
+    FileHeader h;
+    std::memcpy(h.magic, magic, sizeof magic);
+    h.kind = static_cast<std::uint32_t>(kind);
+    h.coord = static_cast<std::uint32_t>(coord);
+    h.count = count;
+    h.byte_order = byte_order;
+    h.version = version;
+    return h;
+}
+
+void expect(const MappedFile& file, FileKind kind, CoordType coord) {
+    const FileHeader& h = file.header();
+    if (h.kind != static_cast<std::uint32_t>(kind)) throw std::runtime_error("unexpected kind of Voronoi file");
+    if (h.coord != static_cast<std::uint32_t>(coord)) throw std::runtime_error("Voronoi file has another coordinate type");
+}
+
+// Checks that n records of the given size from offset on lie in the file.
+// n comes from the file, so it is compared before it is multiplied.
+void expect_records(const MappedFile& file, std::size_t offset, std::uint64_t n, std::size_t size) {
+    if (offset > file.bytes().size() || n > (file.bytes().size() - offset) / size) {
+        throw std::runtime_error("truncated Voronoi file");
+    }
+}
+
+FileDescriptor open_output(const std::string& path, int flags) {
+    FileDescriptor fd(::open(path.c_str(), flags | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd) fail("cannot create " + path);
+    return fd;
+}
+
+void write_all(int fd, const void* p, std::size_t n) {
+    const char* c = static_cast<const char*>(p);
+    while (n > 0) {
+        const ssize_t k = ::write(fd, c, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            fail("write failed");
+        }
+        c += k;
+        n -= static_cast<std::size_t>(k);
+    }
+}
+
+} // namespace
+
+bool FileDescriptor::close() {
+    if (fd < 0) return true;
+    return ::close(std::exchange(fd, -1)) == 0;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    // The mapping keeps the file alive on its own once fd is closed
+    const FileDescriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) fail("cannot open " + path);
+    struct stat st;
+    if (::fstat(fd.get(), &st) < 0) fail("cannot stat " + path);
+    size = static_cast<std::size_t>(st.st_size);
+    if (size > 0) {
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if (p == MAP_FAILED) fail("cannot map " + path);
+        // Sites and chunks are read front to back
+        ::madvise(p, size, MADV_SEQUENTIAL);
+        data = static_cast<const std::byte*>(p);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data) ::munmap(const_cast<std::byte*>(data), size);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+}
+
+const FileHeader& MappedFile::header() const {
+    if (size < sizeof(FileHeader) || std::memcmp(data, magic, sizeof magic) != 0) {
+        throw std::runtime_error("not a Voronoi file");
+    }
+    const FileHeader& h = *reinterpret_cast<const FileHeader*>(data);
+    if (h.byte_order != byte_order) throw std::runtime_error("Voronoi file has another byte order");
+    if (h.version != version) throw std::runtime_error("unsupported Voronoi file version");
+    return h;
+}
+
+template <typename T>
+std::span<const BasicPoint<T>> mapped_sites(const MappedFile& file) {
+    expect(file, FileKind::sites, coord_type_of<T>());
+    const std::uint64_t n = file.header().count;
+    expect_records(file, sizeof(FileHeader), n, sizeof(BasicPoint<T>));
+    return {reinterpret_cast<const BasicPoint<T>*>(file.bytes().data() + sizeof(FileHeader)), n};
+}
+
+template <typename T>
+void write_sites(const std::string& path, std::span<const BasicPoint<T>> sites) {
+    static_assert(std::is_trivially_copyable_v<BasicPoint<T>>);
+    const FileHeader h = make_header(FileKind::sites, coord_type_of<T>(), sites.size());
+    FileDescriptor fd = open_output(path, O_WRONLY);
+    write_all(fd.get(), &h, sizeof h);
+    write_all(fd.get(), sites.data(), sites.size_bytes());
+    if (!fd.close()) fail("cannot close " + path);
+}
+
+template <typename T>
+SiteFileWriter<T>::SiteFileWriter(const std::string& path, std::size_t buffer_sites)
+    : fd(open_output(path, O_WRONLY)), buffer_sites(std::max<std::size_t>(buffer_sites, 1)) {
+    buffer.reserve(this->buffer_sites);
+    const FileHeader h = make_header(FileKind::sites, coord_type_of<T>(), unknown_count);
+    write_all(fd.get(), &h, sizeof h);
+}
+
+template <typename T>
+SiteFileWriter<T>::~SiteFileWriter() {
+    try {
+        close();
+    } catch (...) {
+        // Nothing to report to from a destructor
+    }
+}
+
+template <typename T>
+void SiteFileWriter<T>::add(const BasicPoint<T>& p) {
+    buffer.push_back(p);
+    if (buffer.size() == buffer_sites) flush();
+}
+
+template <typename T>
+void SiteFileWriter<T>::flush() {
+    write_all(fd.get(), buffer.data(), buffer.size() * sizeof(BasicPoint<T>));
+    count += buffer.size();
+    buffer.clear();
+}
+
+template <typename T>
+void SiteFileWriter<T>::close() {
+    if (!fd) return;
+    // Closed here too if the last sites cannot be written
+    try {
+        flush();
+    } catch (...) {
+        fd.close();
+        throw;
+    }
+    FileDescriptor file = std::move(fd);
+    const FileHeader h = make_header(FileKind::sites, coord_type_of<T>(), count);
+    const bool written = ::pwrite(file.get(), &h, sizeof h, 0) == static_cast<ssize_t>(sizeof h);
+    if (!file.close() || !written) fail("cannot finish site file");
+}
+
+template <typename T>
+std::span<const SegmentRecord<T>> mapped_segments(const MappedFile& file) {
+    expect(file, FileKind::segments, coord_type_of<T>());
+    const std::uint64_t n = file.header().count;
+    expect_records(file, sizeof(FileHeader), n, sizeof(SegmentRecord<T>));
+    return {reinterpret_cast<const SegmentRecord<T>*>(file.bytes().data() + sizeof(FileHeader)), n};
+}
+
+template <typename T>
+void for_each_segment_chunk(const MappedFile& file,
+                            const std::function<void(std::span<const SegmentRecord<T>>)>& visit) {
+    expect(file, FileKind::segment_chunks, coord_type_of<T>());
+    // Chunk lengths and records are multiples of 8 bytes, so every chunk
+    // stays aligned for its records
+    std::size_t offset = sizeof(FileHeader);
+    for (;;) {
+        std::uint64_t n;
+        expect_records(file, offset, 1, sizeof n);
+        std::memcpy(&n, file.bytes().data() + offset, sizeof n);
+        offset += sizeof n;
+        if (n == 0) break;
+        expect_records(file, offset, n, sizeof(SegmentRecord<T>));
+        visit({reinterpret_cast<const SegmentRecord<T>*>(file.bytes().data() + offset), n});
+        offset += n * sizeof(SegmentRecord<T>);
+    }
+}
+
+template <typename T>
+SegmentFileWriter<T>::SegmentFileWriter(const std::string& path, std::size_t capacity)
+    : fd(open_output(path, O_RDWR)), capacity(std::max<std::size_t>(capacity, 1)) {
+    map(this->capacity);
+}
+
+template <typename T>
+SegmentFileWriter<T>::~SegmentFileWriter() {
+    try {
+        close();
+    } catch (...) {
+        // Nothing to report to from a destructor
+    }
+}
+
+// Sizes the file for the given number of records and maps all of it. On
+// failure the file is given up, unmapped and closed, so close() has
+// nothing left to finish.
+template <typename T>
+void SegmentFileWriter<T>::map(std::size_t records) {
+    const std::size_t old_bytes = sizeof(FileHeader) + capacity * sizeof(SegmentRecord<T>);
+    const std::size_t bytes = sizeof(FileHeader) + records * sizeof(SegmentRecord<T>);
+    if (data) ::munmap(data, old_bytes);
+    data = nullptr;
+    auto give_up = [this](const char* what) {
+        const int err = errno;
+        fd.close();
+        errno = err;
+        fail(what);
+    };
+    if (::ftruncate(fd.get(), static_cast<off_t>(bytes)) < 0) give_up("cannot grow segment file");
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (p == MAP_FAILED) give_up("cannot map segment file");
+    data = static_cast<std::byte*>(p);
+    capacity = records;
+}
+
+template <typename T>
+void SegmentFileWriter<T>::add(const BasicSegment<T>& s) {
+    if (count == capacity) map(2 * capacity);
+    const SegmentRecord<T> r{s.start, s.end};
+    std::memcpy(data + sizeof(FileHeader) + count * sizeof r, &r, sizeof r);
+    ++count;
+}
+
+template <typename T>
+void SegmentFileWriter<T>::close() {
+    if (!fd) return;
+    const FileHeader h = make_header(FileKind::segments, coord_type_of<T>(), count);
+    std::memcpy(data, &h, sizeof h);
+    ::munmap(data, sizeof(FileHeader) + capacity * sizeof(SegmentRecord<T>));
+    data = nullptr;
+    FileDescriptor file = std::move(fd);
+    const bool trimmed =
+        ::ftruncate(file.get(), static_cast<off_t>(sizeof(FileHeader) + count * sizeof(SegmentRecord<T>))) == 0;
+    if (!file.close() || !trimmed) fail("cannot finish segment file");
+}
+
+template <typename T>
+ChunkedSegmentWriter<T>::ChunkedSegmentWriter(const std::string& path, std::size_t chunk_records)
+    : fd(open_output(path, O_WRONLY)), chunk_records(std::max<std::size_t>(chunk_records, 1)) {
+    buffer.reserve(this->chunk_records);
+    const FileHeader h = make_header(FileKind::segment_chunks, coord_type_of<T>(), unknown_count);
+    write_all(fd.get(), &h, sizeof h);
+}
+
+template <typename T>
+ChunkedSegmentWriter<T>::~ChunkedSegmentWriter() {
+    try {
+        close();
+    } catch (...) {
+        // Nothing to report to from a destructor
+    }
+}
+
+template <typename T>
+void ChunkedSegmentWriter<T>::add(const BasicSegment<T>& s) {
+    buffer.push_back({s.start, s.end});
+    if (buffer.size() == chunk_records) flush();
+}
+
+template <typename T>
+void ChunkedSegmentWriter<T>::flush() {
+    if (buffer.empty()) return;
+    const std::uint64_t n = buffer.size();
+    write_all(fd.get(), &n, sizeof n);
+    write_all(fd.get(), buffer.data(), buffer.size() * sizeof(SegmentRecord<T>));
+    buffer.clear();
+}
+
+template <typename T>
+void ChunkedSegmentWriter<T>::close() {
+    if (!fd) return;
+    // Closed here too if the last chunk cannot be written
+    try {
+        flush();
+    } catch (...) {
+        fd.close();
+        throw;
+    }
+    FileDescriptor file = std::move(fd);
+    const std::uint64_t end = 0;
+    write_all(file.get(), &end, sizeof end);
+    if (!file.close()) fail("cannot finish segment file");
+}
+
+void write_diagram(const std::string& path, const Diagram& diagram) {
+    const FileHeader h = make_header(FileKind::diagram, CoordType::f64, diagram.vertices.size());
+    const std::uint64_t counts[2] = {diagram.half_edges.size(), diagram.faces.size()};
+    FileDescriptor fd = open_output(path, O_WRONLY);
+    write_all(fd.get(), &h, sizeof h);
+    write_all(fd.get(), counts, sizeof counts);
+    write_all(fd.get(), diagram.vertices.data(), diagram.vertices.size() * sizeof(Diagram::Vertex));
+    write_all(fd.get(), diagram.half_edges.data(), diagram.half_edges.size() * sizeof(Diagram::HalfEdge));
+    write_all(fd.get(), diagram.faces.data(), diagram.faces.size() * sizeof(Diagram::Face));
+    if (!fd.close()) fail("cannot close " + path);
+}
+
+Diagram read_diagram(const MappedFile& file) {
+    expect(file, FileKind::diagram, CoordType::f64);
+    std::uint64_t counts[2];
+    expect_records(file, sizeof(FileHeader), 2, sizeof counts[0]);
+    std::memcpy(counts, file.bytes().data() + sizeof(FileHeader), sizeof counts);
+    
+    // Sections in file order
+    Diagram d;
+    std::size_t offset = sizeof(FileHeader) + sizeof counts;
+    auto section = [&](auto& out, std::uint64_t n) {
+        expect_records(file, offset, n, sizeof(out[0]));
+        const std::uint64_t bytes = n * sizeof(out[0]);
+        out.resize(n);
+        std::memcpy(out.data(), file.bytes().data() + offset, bytes);
+        offset += bytes;
+    };
+    section(d.vertices, file.header().count);
+    section(d.half_edges, counts[0]);
+    section(d.faces, counts[1]);
+    return d;
+}
+
+template std::span<const Point> mapped_sites(const MappedFile&);
+template std::span<const PointF> mapped_sites(const MappedFile&);
+template std::span<const PointI> mapped_sites(const MappedFile&);
+template void write_sites(const std::string&, std::span<const Point>);
+template void write_sites(const std::string&, std::span<const PointF>);
+template void write_sites(const std::string&, std::span<const PointI>);
+template class SiteFileWriter<double>;
+template class SiteFileWriter<float>;
+template class SiteFileWriter<std::int32_t>;
+template std::span<const SegmentRecord<double>> mapped_segments(const MappedFile&);
+template std::span<const SegmentRecord<float>> mapped_segments(const MappedFile&);
+template std::span<const SegmentRecord<std::int32_t>> mapped_segments(const MappedFile&);
+template void for_each_segment_chunk(const MappedFile&, const std::function<void(std::span<const SegmentRecord<double>>)>&);
+template void for_each_segment_chunk(const MappedFile&, const std::function<void(std::span<const SegmentRecord<float>>)>&);
+template void for_each_segment_chunk(const MappedFile&, const std::function<void(std::span<const SegmentRecord<std::int32_t>>)>&);
+template class SegmentFileWriter<double>;
+template class SegmentFileWriter<float>;
+template class SegmentFileWriter<std::int32_t>;
+template class ChunkedSegmentWriter<double>;
+template class ChunkedSegmentWriter<float>;
+template class ChunkedSegmentWriter<std::int32_t>;
+
+} // namespace Voronoi
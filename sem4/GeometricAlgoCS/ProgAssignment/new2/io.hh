@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "diagram.hh"
+#include "point.hh"
+#include "voronoi.hh"
+
+namespace Voronoi {
+
+// Binary files of sites, segments and diagrams, read through mmap and
+// written without any formatting. Every file starts with a FileHeader and
+// holds raw records in native byte order:
+//
+//   sites           count BasicPoint<T>
+//   segments        count SegmentRecord<T>
+//   segment chunks  chunks of [std::uint64_t n][n SegmentRecord<T>], ended
+//                   by n = 0; count is unknown (~0) when the file is opened
+//   diagram         [std::uint64_t half_edges][std::uint64_t faces], then
+//                   count vertices, the half-edges and the faces as laid out
+//                   in Diagram (vertex coordinates are always double)
+
+enum class FileKind : std::uint32_t { sites = 1, segments = 2, segment_chunks = 3, diagram = 4 };
+enum class CoordType : std::uint32_t { f64 = 0, f32 = 1, i32 = 2 };
+
+template <typename T>
+constexpr CoordType coord_type_of() {
+    if constexpr (std::is_same_v<T, double>) return CoordType::f64;
+    else if constexpr (std::is_same_v<T, float>) return CoordType::f32;
+    else return CoordType::i32;
+}
+
+struct FileHeader {
+    char magic[8];          // "VORONOI" and a zero
+    std::uint32_t kind;     // FileKind
+    std::uint32_t coord;    // CoordType
+    std::uint64_t count;    // Records (vertices for a diagram)
+    std::uint32_t byte_order; // 0x01020304 as written
+    std::uint32_t version;
+};
+static_assert(sizeof(FileHeader) == 32);
+
+template <typename T>
+struct SegmentRecord {
+    BasicPoint<T> start;
+    BasicPoint<T> end;
+};
+
+// Owns a file descriptor and closes it when it goes, so the writers below
+// do not leak it on any error path
+class FileDescriptor {
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() { close(); }
+    FileDescriptor(FileDescriptor&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept {
+        std::swap(fd, other.fd);
+        return *this;
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    
+    int get() const { return fd; }
+    explicit operator bool() const { return fd >= 0; }
+    // Closes it now; false if close failed, which the destructor cannot say
+    bool close();
+    
+private:
+    int fd = -1;
+};
+
+// Read-only mapping of a whole file. Failures to open or map throw
+// std::system_error, files that are not in the format std::runtime_error.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    std::span<const std::byte> bytes() const { return {data, size}; }
+    const FileHeader& header() const;
+    
+private:
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+};
+
+// Sites of a site file in place, valid while the mapping lives; ready for
+// add_points without a copy in between. T has to match the file.
+template <typename T>
+std::span<const BasicPoint<T>> mapped_sites(const MappedFile& file);
+
+template <typename T>
+void write_sites(const std::string& path, std::span<const BasicPoint<T>> sites);
+
+// Writes a site file front to back through a fixed buffer, for site sets
+// that are produced piecewise; close(), or the destructor, fills in the count
+template <typename T>
+class SiteFileWriter {
+public:
+    explicit SiteFileWriter(const std::string& path, std::size_t buffer_sites = 1 << 16);
+    ~SiteFileWriter();
+    SiteFileWriter(const SiteFileWriter&) = delete;
+    SiteFileWriter& operator=(const SiteFileWriter&) = delete;
+    
+    void add(const BasicPoint<T>& p);
+    void close();
+    
+private:
+    FileDescriptor fd;
+    std::vector<BasicPoint<T>> buffer;
+    std::size_t buffer_sites;
+    std::uint64_t count = 0;
+    
+    void flush();
+};
+
+// Records of a segments file in place
+template <typename T>
+std::span<const SegmentRecord<T>> mapped_segments(const MappedFile& file);
+
+// Calls visit with each chunk of a segment-chunks file in turn
+template <typename T>
+void for_each_segment_chunk(const MappedFile& file,
+                            const std::function<void(std::span<const SegmentRecord<T>>)>& visit);
+
+// Edge sink that stores segments straight into a mapped segments file. The
+// file is preallocated for capacity segments (one compute() over n sites
+// never produces more than 4n) and grows by doubling past that; close(),
+// or the destructor, writes the count and trims the file.
+template <typename T>
+class SegmentFileWriter {
+public:
+    SegmentFileWriter(const std::string& path, std::size_t capacity);
+    ~SegmentFileWriter();
+    SegmentFileWriter(const SegmentFileWriter&) = delete;
+    SegmentFileWriter& operator=(const SegmentFileWriter&) = delete;
+    
+    void add(const BasicSegment<T>& s);
+    // Sink for set_edge_sink; the writer has to outlive the compute()
+    BasicEdgeSink<T> sink() {
+        return [this](const BasicSegment<T>& s) { add(s); };
+    }
+    std::size_t size() const { return count; }
+    void close();
+    
+private:
+    FileDescriptor fd;
+    std::byte* data = nullptr;
+    std::size_t capacity;
+    std::size_t count = 0;
+    
+    void map(std::size_t records);
+};
+
+// Edge sink that writes segment chunks through a fixed buffer, so output of
+// any size streams to a file or pipe in constant memory
+template <typename T>
+class ChunkedSegmentWriter {
+public:
+    explicit ChunkedSegmentWriter(const std::string& path, std::size_t chunk_records = 1 << 16);
+    ~ChunkedSegmentWriter();
+    ChunkedSegmentWriter(const ChunkedSegmentWriter&) = delete;
+    ChunkedSegmentWriter& operator=(const ChunkedSegmentWriter&) = delete;
+    
+    void add(const BasicSegment<T>& s);
+    BasicEdgeSink<T> sink() {
+        return [this](const BasicSegment<T>& s) { add(s); };
+    }
+    void close();
+    
+private:
+    FileDescriptor fd;
+    std::vector<SegmentRecord<T>> buffer;
+    std::size_t chunk_records;
+    
+    void flush();
+};
+
+void write_diagram(const std::string& path, const Diagram& diagram);
+Diagram read_diagram(const MappedFile& file);
+
+} // namespace Voronoi
@@ -0,0 +1,152 @@
+#include "voronoi.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace Voronoi {
+
+namespace {
+
+// True if p is inside or on the convex counterclockwise polygon
+bool inside(std::span<const Point> poly, const Point& p) {
+    for (std::size_t i = 0; i < poly.size(); ++i) {
+        const Point& c = poly[i];
+        const Point& d = poly[(i + 1) % poly.size()];
+        if ((d.x - c.x) * (p.y - c.y) - (d.y - c.y) * (p.x - c.x) < 0.0) return false;
+    }
+    return true;
+}
+
+// Per-face sums of the shoelace formula, taken relative to the face's site
+// to keep the products small. Kept across the steps of relax().
+struct Moments {
+    std::vector<double> area; // Twice the signed area
+    std::vector<double> mx;   // Three times the first moments
+    std::vector<double> my;
+    std::vector<char> cut;    // Face reaches beyond the domain
+    std::vector<char> kept;   // Vertex lies in the domain
+    std::vector<Point> poly;
+    
+    void add(int f, double ax, double ay, double bx, double by) {
+        const double c = ax * by - bx * ay;
+        area[f] += c;
+        mx[f] += (ax + bx) * c;
+        my[f] += (ay + by) * c;
+    }
+};
+
+// Centroid of every cell within the convex domain. Cells inside it are
+// summed edge by edge in a single pass over the half-edges; the few that
+// are open or cross the border are cut to the domain one by one. A site
+// without a cell stays where it is.
+template <typename P>
+void centroids(const Diagram& d, std::span<const P> sites, std::span<const Point> domain,
+               Moments& m, std::vector<Point>& out) {
+    const std::size_t n = sites.size();
+    m.area.assign(n, 0.0);
+    m.mx.assign(n, 0.0);
+    m.my.assign(n, 0.0);
+    m.cut.assign(n, 0);
+    m.kept.resize(d.vertices.size());
+    for (std::size_t v = 0; v < d.vertices.size(); ++v) m.kept[v] = inside(domain, d.vertices[v].p);
+    
+    for (std::size_t h = 0; h < d.half_edges.size(); ++h) {
+        const Diagram::HalfEdge& he = d.half_edges[h];
+        const int a = he.origin, b = d.destination(static_cast<int>(h));
+        if (a < 0 || b < 0 || !m.kept[a] || !m.kept[b]) {
+            m.cut[he.face] = 1;
+            continue;
+        }
+        const Point s = sites[he.face];
+        const Point& pa = d.vertices[a].p;
+        const Point& pb = d.vertices[b].p;
+        m.add(he.face, pa.x - s.x, pa.y - s.y, pb.x - s.x, pb.y - s.y);
+    }
+    
+    out.resize(n);
+    for (std::size_t f = 0; f < n; ++f) {
+        const Point s = sites[f];
+        const int first = d.faces[f].half_edge;
+        out[f] = s;
+        if (first < 0) continue;
+        
+        if (m.cut[f]) {
+            // The region closer to s than to any neighbour, as in cell_polygon
+            m.poly.assign(domain.begin(), domain.end());
+            for (int h = first; h >= 0;) {
+                ClipPolygon::cut(m.poly, s, sites[d.neighbor(h)]);
+                h = d.half_edges[h].next;
+                if (h == first) break;
+            }
+            m.area[f] = m.mx[f] = m.my[f] = 0.0;
+            for (std::size_t i = 0; i < m.poly.size(); ++i) {
+                const Point& a = m.poly[i];
+                const Point& b = m.poly[(i + 1) % m.poly.size()];
+                m.add(static_cast<int>(f), a.x - s.x, a.y - s.y, b.x - s.x, b.y - s.y);
+            }
+        }
+        if (m.area[f] > 0.0) out[f] = {s.x + m.mx[f] / (3 * m.area[f]), s.y + m.my[f] / (3 * m.area[f])};
+    }
+}
+
+} // namespace
+
+template <typename T, typename Geometry>
+RelaxResult BasicFortuneAlgorithm<T, Geometry>::relax(int max_steps, double tolerance) requires (!Geometry::weighted) {
+    RelaxResult result{0, 0.0};
+    if (sites.empty()) return result;
+    
+    // Without a clip region, the bounding box of the starting sites
+    double x0 = sites[0].x, y0 = sites[0].y, x1 = x0, y1 = y0;
+    for (const Site& p : sites) {
+        x0 = std::min<double>(x0, p.x);
+        y0 = std::min<double>(y0, p.y);
+        x1 = std::max<double>(x1, p.x);
+        y1 = std::max<double>(y1, p.y);
+    }
+    const std::vector<Point> domain = clip.empty() ? ClipPolygon::rect(x0, y0, x1, y1).points() : clip.points();
+    
+    // Intermediate steps only need the diagram
+    const bool diagram_was = build_diagram, index_was = build_index;
+    EdgeSink sink = std::move(edge_sink);
+    edge_sink = nullptr;
+    build_diagram = true;
+    build_index = false;
+    
+    Moments moments;
+    std::vector<Point> targets;
+    std::vector<Site> moved(sites.size());
+    for (;;) {
+        compute();
+        centroids<Site>(diagram, sites, domain, moments, targets);
+        
+        // Moves are measured after rounding to T, so integer sites stop
+        // once none of them would move to another grid point
+        result.displacement = 0.0;
+        for (std::size_t s = 0; s < sites.size(); ++s) {
+            moved[s] = Site(targets[s]);
+            const Point a = sites[s], b = moved[s];
+            result.displacement = std::max(result.displacement, std::hypot(b.x - a.x, b.y - a.y));
+        }
+        if (result.displacement <= tolerance || result.steps == max_steps) break;
+        
+        sites.swap(moved);
+        ++result.steps;
+    }
+    
+    build_diagram = diagram_was;
+    build_index = index_was;
+    edge_sink = std::move(sink);
+    if (edge_sink) {
+        // One more sweep of the final sites for the sink, index included
+        compute();
+    } else if (build_index) {
+        site_index.build<T>(sites);
+    }
+    return result;
+}
+
+template RelaxResult BasicFortuneAlgorithm<double>::relax(int, double);
+template RelaxResult BasicFortuneAlgorithm<float>::relax(int, double);
+template RelaxResult BasicFortuneAlgorithm<std::int32_t>::relax(int, double);
+
+} // namespace Voronoi
@@ -0,0 +1,343 @@
+#include "voronoi.hh"
+#include "predicates.hh"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace Voronoi {
+
+namespace {
+
+// One part of the kd-partition: the sites ids[begin, end) and the closed
+// rectangle they were split into
+struct Cell {
+    double x0, y0, x1, y1;
+    std::size_t begin, end;
+};
+
+// The end of a Voronoi edge at the vertex of Delaunay triangle
+// (a, b, third), filed under the site pair (a, b)
+struct EdgeEnd {
+    std::uint64_t key;
+    Point p;
+    std::uint32_t third;
+};
+
+// What one cell's sweep found
+struct CellResult {
+    std::vector<std::pair<Point, Point>> segments; // Edges between two certain vertices
+    std::vector<EdgeEnd> ends;       // Certain ends of the other edges
+    std::vector<std::uint32_t> seam; // Sites the seam pass has to see
+#ifdef VORONOI_STATS
+    SweepStats stats;
+#endif
+};
+
+std::uint64_t pair_key(std::uint32_t a, std::uint32_t b) {
+    if (a > b) std::swap(a, b);
+    return (std::uint64_t(a) << 32) | b;
+}
+
+// Circumcircle of three sites. They are taken in index order so every pass
+// that meets the same triangle gets the same centre, bit for bit.
+template <typename P>
+bool circumcircle(std::span<const P> sites, std::uint32_t i, std::uint32_t j, std::uint32_t k,
+                  Point& o, double& r) {
+    if (i > j) std::swap(i, j);
+    if (j > k) std::swap(j, k);
+    if (i > j) std::swap(i, j);
+    const Point a = sites[i];
+    const Point b = sites[j];
+    const Point c = sites[k];
+    
+    // Same construction as BasicFortuneAlgorithm::circle
+    const double det = orient2d(sites[i], sites[j], sites[k]);
+    if (det == 0) return false;
+    
+    const double A = b.x - a.x;
+    const double B = b.y - a.y;
+    const double C = c.x - a.x;
+    const double D = c.y - a.y;
+    const double E = A * A + B * B;
+    const double F = C * C + D * D;
+    const double G = 2 * det;
+    
+    const double ux = (D * E - B * F) / G;
+    const double uy = (A * F - C * E) / G;
+    o.x = a.x + ux;
+    o.y = a.y + uy;
+    r = std::hypot(ux, uy);
+    return true;
+}
+
+// A circle strictly inside the cell can only hold sites of that cell, so a
+// vertex the cell's own sweep finds with such a circle is a global vertex
+bool fits(const Cell& cell, const Point& o, double r) {
+    const double rr = r + 1e-12 * (std::abs(o.x) + std::abs(o.y) + r);
+    return o.x - rr > cell.x0 && o.x + rr < cell.x1 && o.y - rr > cell.y0 && o.y + rr < cell.y1;
+}
+
+// Faces around vertex v
+void vertex_faces(const Diagram& d, int v, int f[3]) {
+    int h = d.vertices[v].half_edge;
+    for (int j = 0; j < 3; ++j) {
+        f[j] = d.half_edges[h].face;
+        h = d.half_edges[Diagram::twin(h)].next;
+    }
+}
+
+// Splits ids[cell.begin, cell.end) into parts cells of near-equal size,
+// alternating the split axis
+template <typename P>
+void partition(std::span<const P> sites, std::vector<std::uint32_t>& ids, const Cell& cell,
+               unsigned parts, int axis, Cell* out) {
+    if (parts == 1) {
+        *out = cell;
+        return;
+    }
+    
+    auto less = [&sites, axis](std::uint32_t i, std::uint32_t j) {
+        const P& p = sites[i];
+        const P& q = sites[j];
+        return axis == 0 ? p.x < q.x || (p.x == q.x && p.y < q.y)
+                         : p.y < q.y || (p.y == q.y && p.x < q.x);
+    };
+    const unsigned low_parts = parts / 2;
+    const auto first = ids.begin() + cell.begin;
+    const auto last = ids.begin() + cell.end;
+    auto mid = first + (cell.end - cell.begin) * low_parts / parts;
+    
+    Cell low = cell, high = cell;
+    if (mid != last) {
+        std::nth_element(first, mid, last, less);
+        
+        // Copies of the pivot all go high, so equal sites share a cell
+        const std::uint32_t pivot = *mid;
+        mid = std::partition(first, mid, [&](std::uint32_t i) { return less(i, pivot); });
+        const double split = axis == 0 ? sites[pivot].x : sites[pivot].y;
+        (axis == 0 ? low.x1 : low.y1) = split;
+        (axis == 0 ? high.x0 : high.y0) = split;
+    }
+    low.end = high.begin = static_cast<std::size_t>(mid - ids.begin());
+    
+    std::thread worker([&, high] { partition<P>(sites, ids, high, parts - low_parts, 1 - axis, out + low_parts); });
+    partition<P>(sites, ids, low, low_parts, 1 - axis, out);
+    worker.join();
+}
+
+} // namespace
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::compute_parallel(unsigned threads) {
+    // The seams are stitched along straight bisectors
+    if constexpr (Geometry::weighted) {
+        compute();
+        return;
+    }
+    const std::size_t n = sites.size();
+    if (threads <= 1 || build_diagram || build_triangulation || n < 1024 * std::size_t(threads)) {
+        compute();
+        return;
+    }
+    frame(sites);
+    clear_results();
+    
+    // The seam pass checks triangles against every site, and locate_cell
+    // needs the index afterwards anyway
+    std::thread index_builder([this, threads] { site_index.build<T>(sites, threads); });
+    
+    std::vector<std::uint32_t> ids(n);
+    for (std::size_t i = 0; i < n; ++i) ids[i] = static_cast<std::uint32_t>(i);
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<Cell> cells(threads);
+    partition<Site>(sites, ids, {-inf, -inf, inf, inf, 0, n}, threads, 0, cells.data());
+    
+    // Each cell is swept on its own with its own pools. Vertices whose circle
+    // fits in the cell are final; everything near a cell boundary is left
+    // to the seam pass.
+    std::vector<std::uint32_t> cell_of(n);
+    std::vector<CellResult> results(threads);
+    auto sweep_cell = [&](unsigned c) {
+        const Cell& cell = cells[c];
+        CellResult& res = results[c];
+        const std::uint32_t* id = ids.data() + cell.begin;
+        const std::size_t m = cell.end - cell.begin;
+        if (m == 0) return;
+        
+        std::vector<Site> pts(m);
+        for (std::size_t j = 0; j < m; ++j) {
+            pts[j] = sites[id[j]];
+            cell_of[id[j]] = c;
+        }
+        BasicFortuneAlgorithm sub;
+        sub.build_index = false;
+        sub.set_build_diagram(true);
+        sub.set_edge_sink([](const Segment&) {});
+        sub.add_points(pts);
+        sub.compute();
+        VORONOI_STAT(res.stats = sub.sweep_stats);
+        const Diagram& d = sub.get_diagram();
+        
+        if (d.vertices.empty()) {
+            res.seam.assign(id, id + m);
+            return;
+        }
+        
+        const std::size_t nv = d.vertices.size();
+        std::vector<Point> centre(nv);
+        std::vector<char> certain(nv);
+        for (std::size_t v = 0; v < nv; ++v) {
+            int f[3];
+            vertex_faces(d, static_cast<int>(v), f);
+            double r;
+            certain[v] = circumcircle<Site>(sites, id[f[0]], id[f[1]], id[f[2]], centre[v], r)
+                      && fits(cell, centre[v], r);
+            if (!certain[v]) res.seam.insert(res.seam.end(), {id[f[0]], id[f[1]], id[f[2]]});
+        }
+        
+        // Sites with unbounded cells here may have neighbours in other cells
+        for (std::size_t f = 0; f < m; ++f) {
+            const int h = d.faces[f].half_edge;
+            if (h >= 0 && d.half_edges[h].prev < 0) res.seam.push_back(id[f]);
+        }
+        
+        for (std::size_t h = 0; h < d.half_edges.size(); h += 2) {
+            const int u = d.half_edges[h].origin;
+            const int w = d.half_edges[h + 1].origin;
+            const bool cu = u >= 0 && certain[u];
+            const bool cw = w >= 0 && certain[w];
+            if (cu && cw) {
+                res.segments.emplace_back(centre[u], centre[w]);
+            } else if (cu || cw) {
+                const int v = cu ? u : w;
+                const int fa = d.half_edges[h].face;
+                const int fb = d.half_edges[h + 1].face;
+                int f[3];
+                vertex_faces(d, v, f);
+                const int third = f[0] != fa && f[0] != fb ? f[0] : f[1] != fa && f[1] != fb ? f[1] : f[2];
+                res.ends.push_back({pair_key(id[fa], id[fb]), centre[v], id[third]});
+            }
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    for (unsigned c = 1; c < threads; ++c) workers.emplace_back(sweep_cell, c);
+    sweep_cell(0);
+    for (auto& t : workers) t.join();
+    index_builder.join();
+    
+    // Seam pass: one sweep over the boundary sites. A triangle it finds is
+    // kept if no cell could have found it and no site lies in its circle.
+    std::vector<char> in_seam(n, 0);
+    std::vector<std::uint32_t> seam_ids;
+    std::vector<EdgeEnd> ends;
+    for (const CellResult& res : results) {
+        for (std::uint32_t s : res.seam) {
+            if (!in_seam[s]) {
+                in_seam[s] = 1;
+                seam_ids.push_back(s);
+            }
+        }
+        ends.insert(ends.end(), res.ends.begin(), res.ends.end());
+    }
+    
+    std::vector<Site> pts(seam_ids.size());
+    for (std::size_t j = 0; j < seam_ids.size(); ++j) pts[j] = sites[seam_ids[j]];
+    BasicFortuneAlgorithm seam;
+    seam.build_index = false;
+    seam.set_build_diagram(true);
+    seam.set_edge_sink([](const Segment&) {});
+    seam.add_points(pts);
+    seam.compute();
+    const Diagram& d = seam.get_diagram();
+    
+    // Cell and seam sweeps together
+    VORONOI_STAT(sweep_stats = seam.sweep_stats);
+    VORONOI_STAT(for (const CellResult& res : results) sweep_stats.add(res.stats));
+    for (std::size_t v = 0; v < d.vertices.size(); ++v) {
+        int f[3];
+        vertex_faces(d, static_cast<int>(v), f);
+        const std::uint32_t a = seam_ids[f[0]], b = seam_ids[f[1]], c = seam_ids[f[2]];
+        
+        Point o;
+        double r;
+        if (!circumcircle<Site>(sites, a, b, c, o, r)) continue;
+        if (cell_of[a] == cell_of[b] && cell_of[a] == cell_of[c] && fits(cells[cell_of[a]], o, r)) continue;
+        // The site nearest the centre decides; the test itself is exact, as o
+        // carries rounding error on nearly flat triangles
+        const std::uint32_t q = static_cast<std::uint32_t>(site_index.nearest(o));
+        if (q != a && q != b && q != c) {
+            const double inside = incircle(sites[a], sites[b], sites[c], sites[q]);
+            if (orient2d(sites[a], sites[b], sites[c]) > 0 ? inside > 0 : inside < 0) continue;
+        }
+        
+        ends.push_back({pair_key(a, b), o, c});
+        ends.push_back({pair_key(b, c), o, a});
+        ends.push_back({pair_key(a, c), o, b});
+    }
+    
+    // Without a single vertex the sites are collinear; the serial sweep
+    // handles that directly
+    std::size_t certain_edges = 0;
+    for (const CellResult& res : results) certain_edges += res.segments.size();
+    if (ends.empty() && certain_edges == 0) {
+        compute();
+        return;
+    }
+    
+    auto emit = [this](Point a, Point b) {
+        if (!clip.empty() && !clip.clip(a, b)) return;
+        Segment s{Site(a)};
+        s.finish(Site(b));
+        if (edge_sink) {
+            edge_sink(s);
+        } else {
+            output_segments.push_back(s);
+        }
+    };
+    for (const CellResult& res : results) {
+        for (const auto& [a, b] : res.segments) emit(a, b);
+    }
+    
+    // Pair up the edge ends. An edge with one end is a ray, cut off where the
+    // serial sweep's finish_edges would cut it.
+    std::sort(ends.begin(), ends.end(), [](const EdgeEnd& e, const EdgeEnd& f) { return e.key < f.key; });
+    for (std::size_t i = 0; i < ends.size();) {
+        std::size_t j = i + 1;
+        while (j < ends.size() && ends[j].key == ends[i].key) ++j;
+        
+        const Point& start = ends[i].p;
+        if (j - i == 2) {
+            emit(start, ends[i + 1].p);
+        } else if (j - i > 2) {
+            // A vertex found by a cell and again by the seam pass, whose
+            // circles can round to different sides of the cell's border. The
+            // copies sit on the edge, so it runs between the outermost ends.
+            const Point pa = sites[ends[i].key >> 32];
+            const Point pb = sites[ends[i].key & 0xffffffffu];
+            auto along = [&](const EdgeEnd& e) { return (pa.y - pb.y) * e.p.x + (pb.x - pa.x) * e.p.y; };
+            const auto [low, high] = std::minmax_element(ends.begin() + i, ends.begin() + j,
+                                                         [&](const EdgeEnd& e, const EdgeEnd& f) { return along(e) < along(f); });
+            emit(low->p, high->p);
+        } else {
+            const Point pa = sites[ends[i].key >> 32];
+            const Point pb = sites[ends[i].key & 0xffffffffu];
+            const Point pt = sites[ends[i].third];
+            
+            // The ray runs along the bisector, away from the third site
+            Point dir{pa.y - pb.y, pb.x - pa.x};
+            if (dir.x * (pt.x - pa.x) + dir.y * (pt.y - pa.y) > 0) dir = {-dir.x, -dir.y};
+            
+            emit(start, ray_end(pa, pb, start, dir));
+        }
+        i = j;
+    }
+}
+
+template void BasicFortuneAlgorithm<double>::compute_parallel(unsigned);
+template void BasicFortuneAlgorithm<float>::compute_parallel(unsigned);
+template void BasicFortuneAlgorithm<std::int32_t>::compute_parallel(unsigned);
+template void BasicFortuneAlgorithm<double, AdditiveWeights>::compute_parallel(unsigned);
+
+} // namespace Voronoi
@@ -0,0 +1,289 @@
+#include "voronoi.hh"
+#include "queue.hh"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace Voronoi {
+
+namespace {
+
+// Sites copied and sorted per stage, sites per x-range the sweep takes at
+// once, and segments handed to the sink per batch
+constexpr std::size_t chunk_sites = std::size_t(1) << 16;
+constexpr std::size_t range_sites = std::size_t(1) << 16;
+constexpr std::size_t batch_segments = std::size_t(1) << 12;
+constexpr std::uint32_t batches = 8;
+
+template <typename P>
+bool site_less(const P& a, const P& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+struct Box {
+    double x0 = std::numeric_limits<double>::infinity(), y0 = x0;
+    double x1 = -std::numeric_limits<double>::infinity(), y1 = x1;
+    
+    void add(const Box& b) {
+        x0 = std::min(x0, b.x0);
+        y0 = std::min(y0, b.y0);
+        x1 = std::max(x1, b.x1);
+        y1 = std::max(y1, b.y1);
+    }
+};
+
+// Loading and sorting. The producer copies the input chunk by chunk and
+// queues each chunk for the workers, which sort it. Once all are sorted,
+// the last worker picks splitters from them that cut the sites into
+// x-ranges of about range_sites; then the workers merge range after range,
+// lowest first, from the pieces of every chunk into one array in sweep
+// order, and flag each range when it is done.
+template <typename P>
+class SortStages {
+public:
+    SortStages(std::span<const P> input, unsigned workers)
+        : input(input), chunks(input.size()), merged_sites(input.size()),
+          chunk_count((input.size() + chunk_sites - 1) / chunk_sites), boxes(chunk_count),
+          copied(std::max<std::size_t>(2 * workers, 4)) {
+        producer = std::thread([this] { produce(); });
+        for (unsigned w = 0; w < workers; ++w) pool.emplace_back([this] { work(); });
+    }
+    ~SortStages() {
+        producer.join();
+        for (std::thread& t : pool) t.join();
+    }
+    SortStages(const SortStages&) = delete;
+    SortStages& operator=(const SortStages&) = delete;
+    
+    // Bounding box of the sites, once every chunk is sorted
+    const Box& wait_sorted() {
+        laid_out.wait(false, std::memory_order_acquire);
+        return box;
+    }
+    // After wait_sorted()
+    std::size_t ranges() const { return offsets.size() - 1; }
+    std::size_t range_end(std::size_t r) const { return offsets[r + 1]; }
+    void wait_merged(std::size_t r) { merged[r].wait(false, std::memory_order_acquire); }
+    // Sites in sweep order, valid up to range_end(r) once range r is merged
+    std::span<const P> sorted() const { return merged_sites; }
+    
+private:
+    std::span<const P> input;
+    std::vector<P> chunks; // The input, each chunk sorted in place
+    std::vector<P> merged_sites;
+    std::size_t chunk_count;
+    std::vector<Box> boxes; // Per chunk
+    BoundedQueue<std::uint32_t> copied; // Chunks waiting to be sorted
+    std::atomic<std::size_t> sorted_chunks{0};
+    
+    // Filled in by the last chunk's worker
+    std::atomic<bool> laid_out{false};
+    Box box;
+    std::vector<std::size_t> cuts;    // Chunk c's piece of range r: cuts[c (R + 1) + r] up to the next
+    std::vector<std::size_t> offsets; // Range r: merged_sites[offsets[r]] up to offsets[r + 1]
+    std::unique_ptr<std::atomic<bool>[]> merged;
+    std::atomic<std::size_t> next_range{0};
+    
+    std::thread producer;
+    std::vector<std::thread> pool;
+    
+    std::size_t chunk_begin(std::size_t c) const { return c * chunk_sites; }
+    std::size_t chunk_end(std::size_t c) const { return std::min(chunk_begin(c + 1), input.size()); }
+    
+    void produce() {
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            Box& b = boxes[c];
+            for (std::size_t i = chunk_begin(c); i < chunk_end(c); ++i) {
+                const P& p = input[i];
+                chunks[i] = p;
+                b.x0 = std::min<double>(b.x0, p.x);
+                b.y0 = std::min<double>(b.y0, p.y);
+                b.x1 = std::max<double>(b.x1, p.x);
+                b.y1 = std::max<double>(b.y1, p.y);
+            }
+            copied.push(static_cast<std::uint32_t>(c));
+        }
+        copied.close();
+    }
+    
+    void work() {
+        std::uint32_t c;
+        while (copied.pop(c)) {
+            std::sort(chunks.begin() + chunk_begin(c), chunks.begin() + chunk_end(c), site_less<P>);
+            if (sorted_chunks.fetch_add(1, std::memory_order_acq_rel) + 1 == chunk_count) lay_out();
+        }
+        wait_sorted();
+        for (std::size_t r; (r = next_range.fetch_add(1, std::memory_order_relaxed)) < ranges();) {
+            merge(r);
+            merged[r].store(true, std::memory_order_release);
+            merged[r].notify_all();
+        }
+    }
+    
+    void lay_out() {
+        for (const Box& b : boxes) box.add(b);
+        
+        // Evenly spaced samples of every chunk, eight per range
+        const std::size_t range_count = std::max<std::size_t>((input.size() + range_sites - 1) / range_sites, 1);
+        const std::size_t per_chunk = std::max<std::size_t>(8 * range_count / chunk_count, 1);
+        std::vector<P> samples;
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            const std::size_t n = chunk_end(c) - chunk_begin(c);
+            for (std::size_t k = 0; k < per_chunk; ++k) samples.push_back(chunks[chunk_begin(c) + k * n / per_chunk]);
+        }
+        std::sort(samples.begin(), samples.end(), site_less<P>);
+        std::vector<P> splitters;
+        for (std::size_t r = 1; r < range_count; ++r) splitters.push_back(samples[r * samples.size() / range_count]);
+        
+        // Where every chunk crosses the splitters; equal sites stay together
+        const std::size_t stride = range_count + 1;
+        cuts.resize(chunk_count * stride);
+        offsets.assign(stride, 0);
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            const auto first = chunks.begin() + chunk_begin(c), last = chunks.begin() + chunk_end(c);
+            cuts[c * stride] = chunk_begin(c);
+            for (std::size_t r = 1; r < range_count; ++r) {
+                cuts[c * stride + r] = std::lower_bound(first, last, splitters[r - 1], site_less<P>) - chunks.begin();
+            }
+            cuts[c * stride + range_count] = chunk_end(c);
+            for (std::size_t r = 0; r < range_count; ++r) offsets[r + 1] += cuts[c * stride + r + 1] - cuts[c * stride + r];
+        }
+        for (std::size_t r = 0; r < range_count; ++r) offsets[r + 1] += offsets[r];
+        merged = std::make_unique<std::atomic<bool>[]>(range_count);
+        
+        laid_out.store(true, std::memory_order_release);
+        laid_out.notify_all();
+    }
+    
+    // k-way merge of the chunks' pieces of range r, with the next site of
+    // every piece in a heap
+    void merge(std::size_t r) {
+        const std::size_t stride = ranges() + 1;
+        struct Piece {
+            std::size_t next, end;
+        };
+        std::vector<Piece> heap;
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            const Piece p{cuts[c * stride + r], cuts[c * stride + r + 1]};
+            if (p.next < p.end) heap.push_back(p);
+        }
+        auto later = [this](const Piece& a, const Piece& b) { return site_less(chunks[b.next], chunks[a.next]); };
+        std::make_heap(heap.begin(), heap.end(), later);
+        
+        P* out = merged_sites.data() + offsets[r];
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Piece& p = heap.back();
+            *out++ = chunks[p.next++];
+            if (p.next < p.end) {
+                std::push_heap(heap.begin(), heap.end(), later);
+            } else {
+                heap.pop_back();
+            }
+        }
+        assert(out == merged_sites.data() + offsets[r + 1]);
+    }
+};
+
+// Hands the sweep's segments to the sink on a thread of its own, in
+// batches that go round between the two through a pair of queues
+template <typename T>
+class EdgeStage {
+    using S = BasicSegment<T>;
+    
+public:
+    explicit EdgeStage(const BasicEdgeSink<T>& sink) : sink(sink), full(batches), spare(batches) {
+        for (std::uint32_t b = 0; b < batches; ++b) buffers[b].reserve(batch_segments);
+        for (std::uint32_t b = 1; b < batches; ++b) spare.push(b);
+        writer = std::thread([this] { write(); });
+    }
+    ~EdgeStage() {
+        finish();
+    }
+    EdgeStage(const EdgeStage&) = delete;
+    EdgeStage& operator=(const EdgeStage&) = delete;
+    
+    void add(const S& s) {
+        buffers[current].push_back(s);
+        if (buffers[current].size() == batch_segments) {
+            full.push(current);
+            // Waits for the writer once it is batches behind
+            spare.pop(current);
+        }
+    }
+    // Sends off the last batch and waits until the sink has seen everything
+    void finish() {
+        if (!writer.joinable()) return;
+        if (!buffers[current].empty()) full.push(current);
+        full.close();
+        writer.join();
+    }
+    
+private:
+    const BasicEdgeSink<T>& sink;
+    std::vector<S> buffers[batches];
+    std::uint32_t current = 0;
+    BoundedQueue<std::uint32_t> full, spare;
+    std::thread writer;
+    
+    void write() {
+        std::uint32_t b;
+        while (full.pop(b)) {
+            for (const S& s : buffers[b]) sink(s);
+            buffers[b].clear();
+            spare.push(b);
+        }
+    }
+};
+
+} // namespace
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::compute_pipelined(std::span<const Site> input, unsigned threads)
+    requires (!Geometry::weighted) {
+    assert(!build_diagram && !build_triangulation);
+    if (input.empty()) {
+        clear_results();
+        return;
+    }
+    
+    SortStages<Site> stages(input, std::max(threads, 2u) - 1);
+    const Box& box = stages.wait_sorted();
+    frame(box.x0, box.y0, box.x1, box.y1);
+    begin_stream(stages.sorted());
+    VORONOI_STAT(sweep_stats = SweepStats());
+    
+    // The caller's sink moves to the edge stage for the run
+    std::optional<EdgeStage<T>> edges;
+    EdgeSink sink = std::move(edge_sink);
+    if (sink) {
+        edges.emplace(sink);
+        edge_sink = [&edges](const Segment& s) { edges->add(s); };
+    }
+    try {
+        for (std::size_t r = 0; r < stages.ranges(); ++r) {
+            stages.wait_merged(r);
+            sweep_until(stages.range_end(r));
+        }
+        finish_sweep();
+    } catch (...) {
+        edges.reset();
+        edge_sink = std::move(sink);
+        sweep_sites = {};
+        throw;
+    }
+    edges.reset();
+    edge_sink = std::move(sink);
+    sweep_sites = {};
+}
+
+template void BasicFortuneAlgorithm<double>::compute_pipelined(std::span<const Point>, unsigned);
+template void BasicFortuneAlgorithm<float>::compute_pipelined(std::span<const PointF>, unsigned);
+template void BasicFortuneAlgorithm<std::int32_t>::compute_pipelined(std::span<const PointI>, unsigned);
+
+} // namespace Voronoi
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace Voronoi {
+
+// Converts a coordinate to T, rounding to nearest and saturating for
+// integer types
+template <typename T>
+T coord_cast(double v) {
+    if constexpr (std::is_floating_point_v<T>) {
+        return static_cast<T>(v);
+    } else {
+        constexpr double lo = static_cast<double>(std::numeric_limits<T>::lowest());
+        constexpr double hi = static_cast<double>(std::numeric_limits<T>::max());
+        const double r = std::nearbyint(v);
+        if (!(r > lo)) return std::numeric_limits<T>::lowest(); // Also NaN
+        if (r >= hi) return std::numeric_limits<T>::max();
+        return static_cast<T>(r);
+    }
+}
+
+template <typename T>
+struct BasicPoint {
+    T x;
+    T y;
+    
+    BasicPoint(T x = T(), T y = T()) : x(x), y(y) {}
+    
+    // Widening to double is implicit and exact for float and int32_t;
+    // anything else rounds and has to be asked for
+    template <typename U>
+        requires (!std::is_same_v<T, U>)
+    explicit(!std::is_same_v<T, double>) BasicPoint(const BasicPoint<U>& p)
+        : x(coord_cast<T>(static_cast<double>(p.x))), y(coord_cast<T>(static_cast<double>(p.y))) {}
+    
+    bool operator==(const BasicPoint& other) const {
+        return x == other.x && y == other.y;
+    }
+    
+    bool operator!=(const BasicPoint& other) const {
+        return !(*this == other);
+    }
+};
+
+using Point = BasicPoint<double>;
+using PointF = BasicPoint<float>;
+using PointI = BasicPoint<std::int32_t>; // Sites on an integer grid
+
+} // namespace Voronoi
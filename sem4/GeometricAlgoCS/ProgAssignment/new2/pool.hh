@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Voronoi {
+
+// Chunked arena for the sweep's node types. Objects never move once created,
+// destroyed slots are recycled, and clear() drops everything in one shot
+// while keeping the chunks for the next run.
+template <typename T>
+class Pool {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Pool never runs destructors");
+                  
+public:
+    explicit Pool(std::size_t chunk_size = 1024) : chunk_size(chunk_size) {}
+    
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+    
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* slot;
+        if (free_list) {
+            slot = free_list;
+            free_list = free_list->next;
+        } else {
+            if (offset == chunk_size) {
+                ++chunk;
+                offset = 0;
+            }
+            if (chunk == chunks.size()) {
+                chunks.emplace_back(new Slot[chunk_size]);
+            }
+            slot = &chunks[chunk][offset++];
+        }
+        ++live;
+        return new (slot) T(std::forward<Args>(args)...);
+    }
+    
+    void destroy(T* t) {
+        Slot* s = reinterpret_cast<Slot*>(t);
+        s->next = free_list;
+        free_list = s;
+        --live;
+    }
+    
+    // Forget every object; memory is kept for reuse
+    void clear() {
+        chunk = 0;
+        offset = 0;
+        free_list = nullptr;
+        live = 0;
+    }
+    
+    // Have room for n objects without allocating
+    void reserve(std::size_t n) {
+        while (chunks.size() * chunk_size < n) chunks.emplace_back(new Slot[chunk_size]);
+    }
+    
+    // Forget every object and return the memory
+    void release() {
+        clear();
+        chunks.clear();
+    }
+    
+    std::size_t size() const { return live; }
+    
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    
+    std::size_t chunk_size;
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    std::size_t chunk = 0;
+    std::size_t offset = 0;
+    Slot* free_list = nullptr;
+    std::size_t live = 0;
+};
+
+} // namespace Voronoi
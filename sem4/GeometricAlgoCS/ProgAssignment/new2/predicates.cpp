@@ -0,0 +1,154 @@
+#include "predicates.hh"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace Voronoi {
+
+namespace {
+
+constexpr double epsilon = 0x1p-53; // Relative rounding error of one operation
+
+// Bounds on the error of the plain double evaluations, relative to the
+// sum of magnitudes of their terms (Shewchuk's)
+constexpr double orient_bound = (3.0 + 16.0 * epsilon) * epsilon;
+constexpr double incircle_bound = (10.0 + 96.0 * epsilon) * epsilon;
+
+// Exact value as a sum of nonoverlapping doubles, smallest first, without
+// zeros. Only the slow paths build these, so plain vectors will do.
+using Expansion = std::vector<double>;
+
+void two_sum(double a, double b, double& sum, double& err) {
+    sum = a + b;
+    const double bv = sum - a;
+    const double av = sum - bv;
+    err = (a - av) + (b - bv);
+}
+
+Expansion grow(const Expansion& e, double b) {
+    Expansion h;
+    h.reserve(e.size() + 1);
+    double q = b;
+    for (double c : e) {
+        double err;
+        two_sum(q, c, q, err);
+        if (err != 0.0) h.push_back(err);
+    }
+    if (q != 0.0) h.push_back(q);
+    return h;
+}
+
+Expansion sum(Expansion e, const Expansion& f) {
+    for (double c : f) e = grow(e, c);
+    return e;
+}
+
+Expansion negate(Expansion e) {
+    for (double& c : e) c = -c;
+    return e;
+}
+
+Expansion product(const Expansion& e, const Expansion& f) {
+    Expansion h;
+    for (double a : e) {
+        for (double b : f) {
+            const double x = a * b;
+            const double err = std::fma(a, b, -x);
+            if (err != 0.0) h = grow(h, err);
+            h = grow(h, x);
+        }
+    }
+    return h;
+}
+
+Expansion difference(double a, double b) {
+    double x, err;
+    two_sum(a, -b, x, err);
+    Expansion h;
+    if (err != 0.0) h.push_back(err);
+    if (x != 0.0) h.push_back(x);
+    return h;
+}
+
+// Nearest double, with the exact sign
+double estimate(const Expansion& e) {
+    double s = 0.0;
+    for (double c : e) s += c;
+    return s;
+}
+
+double orient2d_exact(const Point& a, const Point& b, const Point& c) {
+    const Expansion acx = difference(a.x, c.x), acy = difference(a.y, c.y);
+    const Expansion bcx = difference(b.x, c.x), bcy = difference(b.y, c.y);
+    return estimate(sum(product(acx, bcy), negate(product(acy, bcx))));
+}
+
+double incircle_exact(const Point& a, const Point& b, const Point& c, const Point& d) {
+    const Expansion adx = difference(a.x, d.x), ady = difference(a.y, d.y);
+    const Expansion bdx = difference(b.x, d.x), bdy = difference(b.y, d.y);
+    const Expansion cdx = difference(c.x, d.x), cdy = difference(c.y, d.y);
+    
+    const Expansion alift = sum(product(adx, adx), product(ady, ady));
+    const Expansion blift = sum(product(bdx, bdx), product(bdy, bdy));
+    const Expansion clift = sum(product(cdx, cdx), product(cdy, cdy));
+    const Expansion bc = sum(product(bdx, cdy), negate(product(cdx, bdy)));
+    const Expansion ca = sum(product(cdx, ady), negate(product(adx, cdy)));
+    const Expansion ab = sum(product(adx, bdy), negate(product(bdx, ady)));
+    return estimate(sum(sum(product(alift, bc), product(blift, ca)), product(clift, ab)));
+}
+
+} // namespace
+
+double orient2d(const Point& a, const Point& b, const Point& c) {
+    const double left = (a.x - c.x) * (b.y - c.y);
+    const double right = (a.y - c.y) * (b.x - c.x);
+    const double det = left - right;
+    
+    // Terms of opposite sign cannot cancel
+    double detsum;
+    if (left > 0.0) {
+        if (right <= 0.0) return det;
+        detsum = left + right;
+    } else if (left < 0.0) {
+        if (right >= 0.0) return det;
+        detsum = -left - right;
+    } else {
+        return det;
+    }
+    if (std::abs(det) >= orient_bound * detsum) return det;
+    return orient2d_exact(a, b, c);
+}
+
+double orient2d(const PointI& a, const PointI& b, const PointI& c) {
+#ifdef __SIZEOF_INT128__
+    // Differences take 33 bits and their products 66
+    const std::int64_t acx = std::int64_t(a.x) - c.x, acy = std::int64_t(a.y) - c.y;
+    const std::int64_t bcx = std::int64_t(b.x) - c.x, bcy = std::int64_t(b.y) - c.y;
+    const __int128 det = static_cast<__int128>(acx) * bcy - static_cast<__int128>(acy) * bcx;
+    return static_cast<double>(det);
+#else
+    return orient2d(Point(a), Point(b), Point(c));
+#endif
+}
+
+double incircle(const Point& a, const Point& b, const Point& c, const Point& d) {
+    const double adx = a.x - d.x, ady = a.y - d.y;
+    const double bdx = b.x - d.x, bdy = b.y - d.y;
+    const double cdx = c.x - d.x, cdy = c.y - d.y;
+    
+    const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    const double cdxady = cdx * ady, adxcdy = adx * cdy;
+    const double adxbdy = adx * bdy, bdxady = bdx * ady;
+    const double alift = adx * adx + ady * ady;
+    const double blift = bdx * bdx + bdy * bdy;
+    const double clift = cdx * cdx + cdy * cdy;
+    
+    const double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+    const double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * alift
+                           + (std::abs(cdxady) + std::abs(adxcdy)) * blift
+                           + (std::abs(adxbdy) + std::abs(bdxady)) * clift;
+    if (std::abs(det) > incircle_bound * permanent) return det;
+    return incircle_exact(a, b, c, d);
+}
+
+} // namespace Voronoi
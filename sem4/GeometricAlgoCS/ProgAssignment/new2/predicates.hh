@@ -0,0 +1,22 @@
+#pragma once
+
+#include "point.hh"
+
+namespace Voronoi {
+
+// Geometric predicates with exact signs, after Shewchuk's adaptive
+// predicates. A floating-point evaluation with an error bound settles
+// almost every call; only when the bound cannot decide the sign is the
+// expression recomputed exactly in expansion arithmetic. The value returned
+// has the exact sign and approximates the exact result.
+
+// > 0 if a, b, c turn counterclockwise, < 0 clockwise, 0 if collinear
+double orient2d(const Point& a, const Point& b, const Point& c);
+// The same for integer sites, evaluated exactly in integer arithmetic
+double orient2d(const PointI& a, const PointI& b, const PointI& c);
+
+// > 0 if d lies inside the circle through a, b, c (taken counterclockwise),
+// < 0 outside, 0 on it
+double incircle(const Point& a, const Point& b, const Point& c, const Point& d);
+
+} // namespace Voronoi
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+namespace Voronoi {
+
+// Bounded multi-producer multi-consumer queue without locks, after Dmitry
+// Vyukov's: a ring of cells, each with a sequence number that says whose
+// turn it is, so a push or pop is one compare-and-swap on its end of the
+// ring and one release store on the cell. A full queue holds producers
+// back; close() lets consumers drain it and then stop.
+template <typename V>
+class BoundedQueue {
+    static_assert(std::is_trivially_copyable_v<V>, "queued values are copied around freely");
+    
+public:
+    // Capacity is rounded up to a power of two
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t n = 2;
+        while (n < capacity) n *= 2;
+        cells = std::make_unique<Cell[]>(n);
+        mask = n - 1;
+        for (std::size_t i = 0; i < n; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+    
+    bool try_push(const V& v) {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells[pos & mask];
+            const std::size_t seq = c.seq.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = v;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos) {
+                return false; // Full: the cell still holds the value from a lap ago
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool try_pop(V& v) {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells[pos & mask];
+            const std::size_t seq = c.seq.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = c.value;
+                    c.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos + 1) {
+                return false; // Empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Blocking forms, which spin for a while and then yield. pop() returns
+    // false once the queue is closed and empty.
+    void push(const V& v) {
+        for (unsigned spins = 0; !try_push(v); ++spins) backoff(spins);
+    }
+    bool pop(V& v) {
+        for (unsigned spins = 0;; ++spins) {
+            if (try_pop(v)) return true;
+            // Whatever was pushed before close() is visible by now
+            if (closed.load(std::memory_order_acquire)) return try_pop(v);
+            backoff(spins);
+        }
+    }
+    void close() { closed.store(true, std::memory_order_release); }
+    
+private:
+    struct alignas(64) Cell {
+        std::atomic<std::size_t> seq;
+        V value;
+    };
+    
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask = 0;
+    alignas(64) std::atomic<std::size_t> tail{0};
+    alignas(64) std::atomic<std::size_t> head{0};
+    std::atomic<bool> closed{false};
+    
+    static void backoff(unsigned spins) {
+        if (spins >= 64) std::this_thread::yield();
+    }
+};
+
+} // namespace Voronoi
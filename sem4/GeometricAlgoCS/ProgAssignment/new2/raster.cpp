@@ -0,0 +1,244 @@
+#include "raster.hh"
+#include <algorithm>
+#include <barrier>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// SSE2 is part of x86-64, AVX2 is looked for at run time
+#if defined(__x86_64__)
+#define VORONOI_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Voronoi {
+
+namespace {
+
+// Pixels that have no site yet sit infinitely far from everything
+constexpr float nowhere = std::numeric_limits<float>::infinity();
+
+// A row of pixels and the row of candidates they look at, shifted in
+// place: each pixel takes the candidate's site if it is strictly nearer
+// to the pixel's center. cx are the centers' x, cy their common y.
+struct Row {
+    const float* cx;
+    float cy;
+    int* label;
+    float* sx;
+    float* sy;
+    const int* cand_label;
+    const float* cand_sx;
+    const float* cand_sy;
+};
+
+using Kernel = void (*)(const Row& r, std::size_t n);
+
+void nearer_scalar(const Row& r, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const float ax = r.cx[i] - r.sx[i], ay = r.cy - r.sy[i];
+        const float bx = r.cx[i] - r.cand_sx[i], by = r.cy - r.cand_sy[i];
+        if (bx * bx + by * by < ax * ax + ay * ay) {
+            r.label[i] = r.cand_label[i];
+            r.sx[i] = r.cand_sx[i];
+            r.sy[i] = r.cand_sy[i];
+        }
+    }
+}
+
+#if defined(VORONOI_X86)
+void nearer_sse2(const Row& r, std::size_t n) {
+    const __m128 cy = _mm_set1_ps(r.cy);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 cx = _mm_loadu_ps(r.cx + i);
+        const __m128 sx = _mm_loadu_ps(r.sx + i), sy = _mm_loadu_ps(r.sy + i);
+        const __m128 tx = _mm_loadu_ps(r.cand_sx + i), ty = _mm_loadu_ps(r.cand_sy + i);
+        const __m128 ax = _mm_sub_ps(cx, sx), ay = _mm_sub_ps(cy, sy);
+        const __m128 bx = _mm_sub_ps(cx, tx), by = _mm_sub_ps(cy, ty);
+        const __m128 a = _mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay));
+        const __m128 b = _mm_add_ps(_mm_mul_ps(bx, bx), _mm_mul_ps(by, by));
+        const __m128 take = _mm_cmplt_ps(b, a);
+        const __m128i take_i = _mm_castps_si128(take);
+        
+        const __m128i label = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r.label + i));
+        const __m128i cand = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r.cand_label + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r.label + i),
+                         _mm_or_si128(_mm_and_si128(take_i, cand), _mm_andnot_si128(take_i, label)));
+        _mm_storeu_ps(r.sx + i, _mm_or_ps(_mm_and_ps(take, tx), _mm_andnot_ps(take, sx)));
+        _mm_storeu_ps(r.sy + i, _mm_or_ps(_mm_and_ps(take, ty), _mm_andnot_ps(take, sy)));
+    }
+    const Row rest{r.cx + i, r.cy, r.label + i, r.sx + i, r.sy + i, r.cand_label + i, r.cand_sx + i, r.cand_sy + i};
+    nearer_scalar(rest, n - i);
+}
+
+__attribute__((target("avx2")))
+void nearer_avx2(const Row& r, std::size_t n) {
+    const __m256 cy = _mm256_set1_ps(r.cy);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 cx = _mm256_loadu_ps(r.cx + i);
+        const __m256 sx = _mm256_loadu_ps(r.sx + i), sy = _mm256_loadu_ps(r.sy + i);
+        const __m256 tx = _mm256_loadu_ps(r.cand_sx + i), ty = _mm256_loadu_ps(r.cand_sy + i);
+        const __m256 ax = _mm256_sub_ps(cx, sx), ay = _mm256_sub_ps(cy, sy);
+        const __m256 bx = _mm256_sub_ps(cx, tx), by = _mm256_sub_ps(cy, ty);
+        const __m256 a = _mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay));
+        const __m256 b = _mm256_add_ps(_mm256_mul_ps(bx, bx), _mm256_mul_ps(by, by));
+        const __m256 take = _mm256_cmp_ps(b, a, _CMP_LT_OQ);
+        
+        // Labels go through the float blend; only their bits are moved
+        const __m256 label = _mm256_loadu_ps(reinterpret_cast<const float*>(r.label + i));
+        const __m256 cand = _mm256_loadu_ps(reinterpret_cast<const float*>(r.cand_label + i));
+        _mm256_storeu_ps(reinterpret_cast<float*>(r.label + i), _mm256_blendv_ps(label, cand, take));
+        _mm256_storeu_ps(r.sx + i, _mm256_blendv_ps(sx, tx, take));
+        _mm256_storeu_ps(r.sy + i, _mm256_blendv_ps(sy, ty, take));
+    }
+    const Row rest{r.cx + i, r.cy, r.label + i, r.sx + i, r.sy + i, r.cand_label + i, r.cand_sx + i, r.cand_sy + i};
+    nearer_sse2(rest, n - i);
+}
+#endif
+
+struct Dispatch {
+    Kernel kernel;
+    const char* isa;
+};
+
+Dispatch pick() {
+#if defined(VORONOI_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {nearer_avx2, "avx2"};
+    return {nearer_sse2, "sse2"};
+#else
+    return {nearer_scalar, "scalar"};
+#endif
+}
+
+// Chosen once, on the first call
+const Dispatch& dispatch() {
+    static const Dispatch d = pick();
+    return d;
+}
+
+} // namespace
+
+const char* raster_isa() {
+    return dispatch().isa;
+}
+
+template <typename T>
+void BasicRasterVoronoi<T>::reset() {
+    sites.clear();
+    std::fill(buffers[result].label.begin(), buffers[result].label.end(), -1);
+}
+
+template <typename T>
+void BasicRasterVoronoi<T>::set_grid(double gx0, double gy0, double gx1, double gy1, int w, int h) {
+    assert(w > 0 && h > 0 && gx1 > gx0 && gy1 > gy0);
+    x0 = gx0;
+    y0 = gy0;
+    dx = (gx1 - gx0) / w;
+    dy = (gy1 - gy0) / h;
+    grid_w = w;
+    grid_h = h;
+    for (Buffer& b : buffers) {
+        b.label.assign(pixels(), -1);
+        b.sx.assign(pixels(), nowhere);
+        b.sy.assign(pixels(), nowhere);
+    }
+    centers.resize(w);
+    for (int i = 0; i < w; ++i) centers[i] = static_cast<float>((i + 0.5) * dx);
+    result = 0;
+}
+
+// Every site goes to the pixel it falls into, or the nearest border pixel;
+// of several sites there the one nearest to the center stays
+template <typename T>
+void BasicRasterVoronoi<T>::seed() {
+    Buffer& b = buffers[0];
+    std::fill(b.label.begin(), b.label.end(), -1);
+    std::fill(b.sx.begin(), b.sx.end(), nowhere);
+    std::fill(b.sy.begin(), b.sy.end(), nowhere);
+    for (std::size_t s = 0; s < sites.size(); ++s) {
+        const float px = static_cast<float>(static_cast<double>(sites[s].x) - x0);
+        const float py = static_cast<float>(static_cast<double>(sites[s].y) - y0);
+        const int i = static_cast<int>(std::clamp(std::floor(px / dx), 0.0, grid_w - 1.0));
+        const int j = static_cast<int>(std::clamp(std::floor(py / dy), 0.0, grid_h - 1.0));
+        const std::size_t k = static_cast<std::size_t>(j) * grid_w + i;
+        const float cy = static_cast<float>((j + 0.5) * dy);
+        const float ax = centers[i] - b.sx[k], ay = cy - b.sy[k];
+        const float bx = centers[i] - px, by = cy - py;
+        if (bx * bx + by * by < ax * ax + ay * ay) {
+            b.label[k] = static_cast<int>(s);
+            b.sx[k] = px;
+            b.sy[k] = py;
+        }
+    }
+}
+
+template <typename T>
+void BasicRasterVoronoi<T>::flood(int from, int step, int j0, int j1) {
+    const Buffer& src = buffers[from];
+    Buffer& dst = buffers[1 - from];
+    const Kernel kernel = dispatch().kernel;
+    const std::size_t w = static_cast<std::size_t>(grid_w);
+    for (int j = j0; j < j1; ++j) {
+        const std::size_t row = static_cast<std::size_t>(j) * w;
+        std::memcpy(dst.label.data() + row, src.label.data() + row, w * sizeof(int));
+        std::memcpy(dst.sx.data() + row, src.sx.data() + row, w * sizeof(float));
+        std::memcpy(dst.sy.data() + row, src.sy.data() + row, w * sizeof(float));
+        
+        const float cy = static_cast<float>((j + 0.5) * dy);
+        for (int oy = -step; oy <= step; oy += step) {
+            const int jj = j + oy;
+            if (jj < 0 || jj >= grid_h) continue;
+            for (int ox = -step; ox <= step; ox += step) {
+                if (ox == 0 && oy == 0) continue;
+                // Pixels whose neighbour at ox is still on the row
+                const int lo = std::max(0, -ox), hi = std::min(grid_w, grid_w - ox);
+                if (lo >= hi) continue;
+                const std::size_t at = row + lo, cand = static_cast<std::size_t>(jj) * w + lo + ox;
+                const Row r{centers.data() + lo, cy, dst.label.data() + at, dst.sx.data() + at, dst.sy.data() + at,
+                            src.label.data() + cand, src.sx.data() + cand, src.sy.data() + cand};
+                kernel(r, static_cast<std::size_t>(hi - lo));
+            }
+        }
+    }
+}
+
+template <typename T>
+void BasicRasterVoronoi<T>::compute() {
+    result = 0;
+    if (pixels() == 0) return;
+    seed();
+    if (sites.empty()) return;
+    
+    // Steps from half the grid size (rounded up to a power of two) down to 1
+    std::vector<int> steps;
+    int step = 1;
+    while (2 * step < std::max(grid_w, grid_h)) step *= 2;
+    for (; step >= 1; step /= 2) steps.push_back(step);
+    if (refine) steps.push_back(1);
+    
+    // Bands of rows per thread, in step from pass to pass
+    const int bands = static_cast<int>(std::min<unsigned>(threads, static_cast<unsigned>(grid_h)));
+    auto band = [&](int t) { return static_cast<int>(static_cast<long long>(grid_h) * t / bands); };
+    std::barrier sync(bands);
+    auto work = [&](int t) {
+        for (std::size_t p = 0; p < steps.size(); ++p) {
+            flood(static_cast<int>(p % 2), steps[p], band(t), band(t + 1));
+            sync.arrive_and_wait();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < bands; ++t) workers.emplace_back(work, t);
+    work(0);
+    for (std::thread& t : workers) t.join();
+    result = static_cast<int>(steps.size() % 2);
+}
+
+template class BasicRasterVoronoi<double>;
+template class BasicRasterVoronoi<float>;
+template class BasicRasterVoronoi<std::int32_t>;
+
+} // namespace Voronoi
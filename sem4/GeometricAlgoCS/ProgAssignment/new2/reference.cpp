@@ -0,0 +1,616 @@
+#include "reference.hh"
+#include "external.hh"
+#include "io.hh"
+#include "voronoi.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <unordered_map>
+
+#include <unistd.h>
+
+namespace Voronoi {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+double distance(const Point& a, const Point& b) {
+    return std::hypot(b.x - a.x, b.y - a.y);
+}
+
+struct Corner {
+    Point p;
+    int across; // Site across the edge starting here, -1 along the box
+};
+
+// Keeps the part of the cell of s that is closer to s than to site t at
+// tp; the edge the cut leaves is across t
+void cut(std::vector<Corner>& cell, std::vector<Corner>& tmp, const Point& s, const Point& tp, int t) {
+    const double nx = tp.x - s.x, ny = tp.y - s.y, half = (nx * nx + ny * ny) / 2;
+    auto side = [&](const Point& q) { return half - (nx * (q.x - s.x) + ny * (q.y - s.y)); };
+
+    tmp.clear();
+    for (std::size_t i = 0; i < cell.size(); ++i) {
+        const Corner& a = cell[i];
+        const Corner& b = cell[(i + 1) % cell.size()];
+        const double fa = side(a.p), fb = side(b.p);
+        if (fa >= 0.0) tmp.push_back(a);
+        if ((fa >= 0.0) != (fb >= 0.0)) {
+            const double u = fa / (fa - fb);
+            const Point q{a.p.x + u * (b.p.x - a.p.x), a.p.y + u * (b.p.y - a.p.y)};
+            // Leaving the half-plane the bisector starts, entering it a's edge goes on
+            tmp.push_back({q, fa >= 0.0 ? t : a.across});
+        }
+    }
+    cell.swap(tmp);
+}
+
+// Center of the circle through a, b and c, or fallback if they are too
+// close to collinear for it to be any better
+Point circumcenter(const Point& a, const Point& b, const Point& c, const Point& fallback, double slack) {
+    const long double bx = static_cast<long double>(b.x) - a.x, by = static_cast<long double>(b.y) - a.y;
+    const long double cx = static_cast<long double>(c.x) - a.x, cy = static_cast<long double>(c.y) - a.y;
+    const long double d = 2 * (bx * cy - by * cx);
+    if (d == 0) return fallback;
+    const long double b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+    const Point p{static_cast<double>(a.x + (cy * b2 - by * c2) / d), static_cast<double>(a.y + (bx * c2 - cx * b2) / d)};
+    return distance(p, fallback) <= slack ? p : fallback;
+}
+
+template <typename T>
+double default_tolerance(double scale) {
+    if constexpr (std::is_same_v<T, double>) {
+        return 1e-9 * scale;
+    } else if constexpr (std::is_same_v<T, float>) {
+        return 1e-6 * scale;
+    } else {
+        return std::max(1.0, 1e-9 * scale);
+    }
+}
+
+// The few sites of by_x (sorted by x) nearest to q, nearest first, by a
+// scan outward from q.x that stops where the x distance alone exceeds the
+// farthest of them
+struct Nearest {
+    static constexpr int k = 8;
+    int site[k] = {};
+    double d2[k] = {}; // Squared distances
+    int size = 0;
+};
+
+Nearest nearest(std::span<const int> by_x, std::span<const Point> at, const Point& q) {
+    Nearest n;
+    auto offer = [&](int s) {
+        const double dx = at[s].x - q.x, dy = at[s].y - q.y, d = dx * dx + dy * dy;
+        if (n.size == Nearest::k && d >= n.d2[Nearest::k - 1]) return;
+        int i = n.size < Nearest::k ? n.size++ : Nearest::k - 1;
+        for (; i > 0 && n.d2[i - 1] > d; --i) {
+            n.site[i] = n.site[i - 1];
+            n.d2[i] = n.d2[i - 1];
+        }
+        n.site[i] = s;
+        n.d2[i] = d;
+    };
+    auto bound = [&n] { return n.size < Nearest::k ? std::numeric_limits<double>::infinity() : n.d2[Nearest::k - 1]; };
+    std::size_t hi = std::lower_bound(by_x.begin(), by_x.end(), q.x, [&](int s, double x) { return at[s].x < x; })
+                     - by_x.begin();
+    std::size_t lo = hi;
+    for (bool more = true; more;) {
+        more = false;
+        if (hi < by_x.size()) {
+            const double dx = at[by_x[hi]].x - q.x;
+            if (dx * dx <= bound()) {
+                offer(by_x[hi++]);
+                more = true;
+            }
+        }
+        if (lo > 0) {
+            const double dx = q.x - at[by_x[lo - 1]].x;
+            if (dx * dx <= bound()) {
+                offer(by_x[--lo]);
+                more = true;
+            }
+        }
+    }
+    return n;
+}
+
+// Cuts [t0, t1] down to the part of the line m + t u (u of unit length)
+// inside the box; false if nothing is left. Segments are cut here and not
+// with ClipPolygon, which is part of what is checked, and the line is
+// taken from a point near the box, so far-off ends do not cost precision.
+bool cut_to_box(const ReferenceCells& ref, const Point& m, const Point& u, double& t0, double& t1) {
+    auto axis = [&](double from, double rate, double lo, double hi) {
+        if (rate == 0.0) return from >= lo && from <= hi;
+        double ta = (lo - from) / rate, tb = (hi - from) / rate;
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        return true;
+    };
+    return axis(m.x, u.x, ref.x0, ref.x1) && axis(m.y, u.y, ref.y0, ref.y1) && t0 <= t1;
+}
+
+// Lengths in the box of the edge between two owners, as the reference,
+// the diagram and the segments have it
+struct Pair {
+    double reference = 0.0, diagram = 0.0, segments = 0.0;
+    int diagram_pieces = 0, segment_pieces = 0;
+    Point from, to; // The reference's edge, its longest piece if split
+};
+
+// A piece of a segment that fits the edges of more than one pair, with
+// how far it keeps from each
+struct Ambiguous {
+    double length = 0.0;
+    std::vector<std::pair<double, Pair*>> fits;
+};
+
+std::uint64_t pair_key(int a, int b) {
+    if (a > b) std::swap(a, b);
+    return static_cast<std::uint64_t>(a) << 32 | static_cast<std::uint32_t>(b);
+}
+
+double distance_to_segment(const Point& q, const Point& a, const Point& b) {
+    const double dx = b.x - a.x, dy = b.y - a.y, l2 = dx * dx + dy * dy;
+    const double t = l2 > 0.0 ? std::clamp(((q.x - a.x) * dx + (q.y - a.y) * dy) / l2, 0.0, 1.0) : 0.0;
+    return distance(q, {a.x + t * dx, a.y + t * dy});
+}
+
+// A fresh name in the system's temporary directory
+std::string temp_path(const char* what) {
+    static std::atomic<unsigned> serial{0};
+    const std::string name = "voronoi-check-" + std::string(what) + "-" + std::to_string(::getpid()) + "-"
+                             + std::to_string(serial++) + ".bin";
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+} // namespace
+
+const char* sweep_mode_name(SweepMode mode) {
+    switch (mode) {
+    case SweepMode::serial:
+        return "serial";
+    case SweepMode::parallel:
+        return "parallel";
+    case SweepMode::stream:
+        return "stream";
+    case SweepMode::pipelined:
+        return "pipelined";
+    case SweepMode::out_of_core:
+        return "out_of_core";
+    case SweepMode::file_pipelined:
+        return "file_pipelined";
+    }
+    return "?";
+}
+
+template <typename T>
+void reference_cells(std::span<const BasicPoint<T>> sites, ReferenceCells& out) {
+    const auto start = Clock::now();
+    const std::size_t n = sites.size();
+    out.owner.resize(n);
+    out.corners.clear();
+    out.across.clear();
+    out.offsets.assign(n + 1, 0);
+    if (n == 0) {
+        out.x0 = out.y0 = out.x1 = out.y1 = 0.0;
+        out.build_ms = ms_since(start);
+        return;
+    }
+    std::vector<Point> at(sites.begin(), sites.end());
+
+    // Owners: the first of every run of equal sites
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return at[a].x < at[b].x || (at[a].x == at[b].x && (at[a].y < at[b].y || (at[a].y == at[b].y && a < b)));
+    });
+    std::vector<int> owners;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (i == 0 || at[order[i]] != at[order[i - 1]]) owners.push_back(order[i]);
+        out.owner[order[i]] = owners.back();
+    }
+
+    double x0 = at[0].x, x1 = x0, y0 = at[0].y, y1 = y0;
+    for (const Point& p : at) {
+        x0 = std::min(x0, p.x);
+        x1 = std::max(x1, p.x);
+        y0 = std::min(y0, p.y);
+        y1 = std::max(y1, p.y);
+    }
+    const double grow = std::max({x1 - x0, y1 - y0, 1.0});
+    out.x0 = x0 - grow;
+    out.y0 = y0 - grow;
+    out.x1 = x1 + grow;
+    out.y1 = y1 + grow;
+    if constexpr (std::is_integral_v<T>) {
+        out.x0 = std::floor(out.x0);
+        out.y0 = std::floor(out.y0);
+        out.x1 = std::ceil(out.x1);
+        out.y1 = std::ceil(out.y1);
+    }
+    const double slack = 1e-6 * std::max(out.x1 - out.x0, out.y1 - out.y0);
+
+    std::vector<Corner> cell, tmp;
+    for (std::size_t i = 0; i < n; ++i) {
+        const int s = static_cast<int>(i);
+        out.offsets[i] = out.corners.size();
+        if (out.owner[s] != s) continue;
+        const Point& p = at[s];
+        cell.assign({{{out.x0, out.y0}, -1}, {{out.x1, out.y0}, -1}, {{out.x1, out.y1}, -1}, {{out.x0, out.y1}, -1}});
+        // Squared distance from s to its farthest corner: bisectors of
+        // sites beyond twice it miss the cell
+        auto reach = [&] {
+            double r = 0.0;
+            for (const Corner& c : cell) r = std::max(r, (c.p.x - p.x) * (c.p.x - p.x) + (c.p.y - p.y) * (c.p.y - p.y));
+            return r;
+        };
+        double r2 = reach();
+        for (int t : owners) {
+            if (t == s) continue;
+            const double dx = at[t].x - p.x, dy = at[t].y - p.y;
+            if ((dx * dx + dy * dy) / 4 >= r2) continue;
+            cut(cell, tmp, p, at[t], t);
+            r2 = reach();
+        }
+
+        // Corners between two bisectors, from the three sites
+        for (std::size_t k = 0; k < cell.size(); ++k) {
+            const int before = cell[(k + cell.size() - 1) % cell.size()].across, after = cell[k].across;
+            Point q = cell[k].p;
+            if (before >= 0 && after >= 0 && before != after) q = circumcenter(p, at[before], at[after], q, slack);
+            out.corners.push_back(q);
+            out.across.push_back(after);
+        }
+    }
+    out.offsets[n] = out.corners.size();
+    out.build_ms = ms_since(start);
+}
+
+template <typename T>
+ReferenceCheck check_against_reference(std::span<const BasicPoint<T>> sites, const ReferenceCells& reference,
+                                       SweepMode mode, const CheckOptions& options) {
+    using Site = BasicPoint<T>;
+    using Segment = BasicSegment<T>;
+    const ReferenceCells& ref = reference;
+    const std::size_t n = sites.size();
+    ReferenceCheck r;
+    r.reference_ms = ref.build_ms;
+    const double scale = std::max({ref.x1 - ref.x0, ref.y1 - ref.y0, std::abs(ref.x0), std::abs(ref.x1),
+                                   std::abs(ref.y0), std::abs(ref.y1)});
+    const double tol = options.tolerance > 0.0 ? options.tolerance : default_tolerance<T>(scale);
+    r.tolerance = tol;
+
+    // The sweep, timed
+    BasicFortuneAlgorithm<T> f;
+    f.set_clip_rect(ref.x0, ref.y0, ref.x1, ref.y1);
+    f.set_build_diagram(mode == SweepMode::serial);
+    f.set_build_index(false);
+    std::vector<Site> sorted;
+    std::vector<Segment> streamed;
+    const bool to_file = mode == SweepMode::out_of_core || mode == SweepMode::file_pipelined;
+    std::string sites_path, segments_path;
+    if (to_file) {
+        sites_path = temp_path("sites");
+        segments_path = temp_path("segments");
+        write_sites<T>(sites_path, sites);
+    } else if (mode == SweepMode::stream) {
+        sorted.assign(sites.begin(), sites.end());
+        std::sort(sorted.begin(), sorted.end(), [](const Site& a, const Site& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        f.set_edge_sink([&streamed](const Segment& s) { streamed.push_back(s); });
+    } else if (mode != SweepMode::pipelined) {
+        f.add_points(sites);
+    }
+    r.sweep_ms = std::numeric_limits<double>::infinity();
+    for (int k = 0; k < std::max(options.repeats, 1); ++k) {
+        streamed.clear();
+        const auto start = Clock::now();
+        switch (mode) {
+        case SweepMode::serial:
+            f.compute();
+            break;
+        case SweepMode::parallel:
+            f.compute_parallel(options.threads);
+            break;
+        case SweepMode::stream:
+            f.compute_stream(sorted);
+            break;
+        case SweepMode::pipelined:
+            f.compute_pipelined(sites, options.threads);
+            break;
+        case SweepMode::out_of_core:
+            // Runs of a quarter of the sites, so the merge is taken too
+            compute_out_of_core(f, sites_path, segments_path, std::max<std::size_t>(n / 4, 1) * sizeof(Site));
+            break;
+        case SweepMode::file_pipelined:
+            compute_file_pipelined(f, sites_path, segments_path, options.threads);
+            break;
+        }
+        r.sweep_ms = std::min(r.sweep_ms, ms_since(start));
+    }
+    if (to_file) {
+        const MappedFile file(segments_path);
+        for_each_segment_chunk<T>(file, [&streamed](std::span<const SegmentRecord<T>> chunk) {
+            for (const SegmentRecord<T>& s : chunk) {
+                streamed.emplace_back(s.start);
+                streamed.back().finish(s.end);
+            }
+        });
+        std::error_code ec;
+        std::filesystem::remove(sites_path, ec);
+        std::filesystem::remove(segments_path, ec);
+    }
+    if (n == 0) return r;
+
+    std::vector<Point> at(sites.begin(), sites.end());
+    std::vector<int> by_x;
+    for (std::size_t s = 0; s < n; ++s) {
+        if (ref.owner[s] == static_cast<int>(s)) by_x.push_back(static_cast<int>(s));
+    }
+    std::sort(by_x.begin(), by_x.end(), [&](int a, int b) { return at[a].x < at[b].x; });
+    r.sites = by_x.size();
+
+    std::unordered_map<std::uint64_t, Pair> pairs;
+    auto pair_of = [&pairs](int a, int b) -> Pair& { return pairs[pair_key(a, b)]; };
+    auto note = [&r](double deviation, double allowed, std::size_t& bad) {
+        r.worst = std::max(r.worst, deviation);
+        if (!(deviation <= allowed)) ++bad;
+    };
+    for (int c : by_x) {
+        const std::span<const Point> corners = ref.cell(c);
+        const std::span<const int> across = ref.cell_across(c);
+        for (std::size_t k = 0; k < corners.size(); ++k) {
+            if (across[k] <= c) continue;
+            const Point& from = corners[k];
+            const Point& to = corners[(k + 1) % corners.size()];
+            Pair& p = pair_of(c, across[k]);
+            if (distance(from, to) > distance(p.from, p.to)) {
+                p.from = from;
+                p.to = to;
+            }
+            p.reference += distance(from, to);
+        }
+    }
+
+    // Segments: on the bisector of the two sites nearest to them
+    const Point centre{(ref.x0 + ref.x1) / 2, (ref.y0 + ref.y1) / 2};
+    std::vector<Ambiguous> ambiguous;
+    const std::span<const Segment> segments = mode == SweepMode::stream || to_file ? std::span<const Segment>(streamed)
+                                                                                    : f.segments();
+    for (const Segment& s : segments) {
+        Point a(s.start), b(s.end);
+        const double len = distance(a, b);
+        if (!(len > 0.0)) continue;
+        const Point u{(b.x - a.x) / len, (b.y - a.y) / len};
+        const Point& e = distance(a, centre) < distance(b, centre) ? a : b;
+        const double along = (centre.x - e.x) * u.x + (centre.y - e.y) * u.y;
+        const Point m{e.x + along * u.x, e.y + along * u.y};
+        double t0 = (a.x - m.x) * u.x + (a.y - m.y) * u.y, t1 = (b.x - m.x) * u.x + (b.y - m.y) * u.y;
+        if (!cut_to_box(ref, m, u, t0, t1)) continue;
+        a = {m.x + t0 * u.x, m.y + t0 * u.y};
+        b = {m.x + t1 * u.x, m.y + t1 * u.y};
+        ++r.segments;
+        const Point mid{(a.x + b.x) / 2, (a.y + b.y) / 2};
+        const Point points[3] = {a, mid, b};
+        // No site may be nearer to any of the three than the two nearest
+        // are to each other
+        double off = 0.0;
+        for (const Point& q : points) {
+            const Nearest near = nearest(by_x, at, q);
+            off = near.size < 2 ? std::numeric_limits<double>::infinity()
+                                : std::max(off, std::sqrt(near.d2[1]) - std::sqrt(near.d2[0]));
+        }
+        note(off, 2 * tol, r.bad_segments);
+
+        // The piece belongs to a pair of sites near its middle whose edge
+        // in the reference it keeps to. Which two sites are nearest is no
+        // guide where rounding moved a short piece near a vertex, and more
+        // than one edge may fit where rounding leaves nearly collinear
+        // edges apart by less than the tolerance; such pieces wait until
+        // the rest are in. With no edge fitting the closest one takes it,
+        // and with no edge at all its length counts as stray.
+        const Nearest near = nearest(by_x, at, mid);
+        Ambiguous piece{t1 - t0, {}};
+        Pair* closest = nullptr;
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < near.size; ++i) {
+            for (int j = i + 1; j < near.size; ++j) {
+                const auto it = pairs.find(pair_key(near.site[i], near.site[j]));
+                if (it == pairs.end() || it->second.reference == 0.0) continue;
+                double apart = 0.0;
+                for (const Point& q : points) apart = std::max(apart, distance_to_segment(q, it->second.from, it->second.to));
+                if (apart <= 2 * tol) piece.fits.emplace_back(apart, &it->second);
+                if (apart < best) {
+                    best = apart;
+                    closest = &it->second;
+                }
+            }
+        }
+        if (!closest) {
+            note(piece.length, 2 * tol, r.bad_edges);
+        } else if (piece.fits.size() > 1) {
+            ambiguous.push_back(std::move(piece));
+        } else {
+            closest->segments += piece.length;
+            ++closest->segment_pieces;
+        }
+    }
+    // Longest first, each to the closest pair it fits that is still missing
+    // about its length, or else to the one missing most
+    std::sort(ambiguous.begin(), ambiguous.end(),
+              [](const Ambiguous& a, const Ambiguous& b) { return a.length > b.length; });
+    for (Ambiguous& piece : ambiguous) {
+        std::sort(piece.fits.begin(), piece.fits.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        auto missing = [](const Pair* p) { return p->reference - p->segments; };
+        Pair* owner = nullptr;
+        for (const auto& [apart, p] : piece.fits) {
+            if (missing(p) >= piece.length - 2 * tol) {
+                owner = p;
+                break;
+            }
+            if (!owner || missing(p) > missing(owner)) owner = p;
+        }
+        owner->segments += piece.length;
+        ++owner->segment_pieces;
+    }
+
+    if (mode == SweepMode::serial) {
+        const Diagram& d = f.get_diagram();
+        if (d.faces.size() != n) {
+            r.bad_faces = n;
+            return r;
+        }
+        // One face with a cell for every owner, unless there is only one
+        std::vector<int> faces(n, 0);
+        for (std::size_t s = 0; s < n; ++s) {
+            if (d.faces[s].half_edge >= 0) ++faces[ref.owner[s]];
+        }
+        if (by_x.size() > 1) {
+            for (int c : by_x) {
+                if (faces[c] != 1) ++r.bad_faces;
+            }
+        }
+
+        // Links, and the walk around every face
+        const int edges = static_cast<int>(d.half_edges.size());
+        for (int h = 0; h < edges; ++h) {
+            const Diagram::HalfEdge& e = d.half_edges[h];
+            if (e.face < 0) continue;
+            bool fits = d.half_edges[Diagram::twin(h)].face >= 0 && d.faces[e.face].half_edge >= 0;
+            if (e.next >= 0) {
+                const Diagram::HalfEdge& next = d.half_edges[e.next];
+                fits = fits && next.prev == h && next.face == e.face && d.destination(h) >= 0
+                       && next.origin == d.destination(h);
+            } else {
+                fits = fits && d.destination(h) < 0;
+            }
+            if (e.prev >= 0) {
+                fits = fits && d.half_edges[e.prev].next == h;
+            } else {
+                fits = fits && e.origin < 0;
+            }
+            if (e.origin >= 0) fits = fits && d.vertices[e.origin].half_edge >= 0;
+            if (!fits) ++r.bad_links;
+        }
+        for (std::size_t s = 0; s < n; ++s) {
+            const int first = d.faces[s].half_edge;
+            int h = first, steps = 0;
+            while (h >= 0 && steps <= edges && d.half_edges[h].face == static_cast<int>(s)) {
+                h = d.half_edges[h].next;
+                ++steps;
+                if (h == first) break;
+            }
+            if (h >= 0 && h != first) ++r.bad_links;
+        }
+
+        // Edges, cut to the box; open ends run along the bisector, with the
+        // face on the left
+        std::vector<std::pair<int, int>> corners; // (owner, vertex)
+        for (int h = 0; h < edges; ++h) {
+            const Diagram::HalfEdge& e = d.half_edges[h];
+            if (e.face < 0) continue;
+            if (e.origin >= 0) corners.emplace_back(ref.owner[e.face], e.origin);
+            const int g = d.neighbor(h);
+            if (h % 2 != 0 || g < 0) continue;
+            const int oa = ref.owner[e.face], ob = ref.owner[g];
+            if (oa == ob) {
+                ++r.bad_links;
+                continue;
+            }
+            const Point& sa = at[e.face];
+            const Point& sb = at[g];
+            const double len = distance(sa, sb);
+            const Point dir{-(sb.y - sa.y) / len, (sb.x - sa.x) / len};
+            const Point m{(sa.x + sb.x) / 2, (sa.y + sb.y) / 2};
+            auto along = [&](int v) { return (d.vertices[v].p.x - m.x) * dir.x + (d.vertices[v].p.y - m.y) * dir.y; };
+            const double inf = std::numeric_limits<double>::infinity();
+            double t0 = e.origin >= 0 ? along(e.origin) : -inf, t1 = d.destination(h) >= 0 ? along(d.destination(h)) : inf;
+            Pair& p = pair_of(oa, ob);
+            ++p.diagram_pieces;
+            if (t0 > t1) {
+                ++r.bad_links; // Runs against the face's orientation
+            } else if (cut_to_box(ref, m, dir, t0, t1)) {
+                p.diagram += t1 - t0;
+            }
+        }
+
+        // Vertices well inside the box against the cells' corners where
+        // two bisectors meet, both ways
+        std::sort(corners.begin(), corners.end());
+        corners.erase(std::unique(corners.begin(), corners.end()), corners.end());
+        auto inside = [&](const Point& q) {
+            return q.x > ref.x0 + 2 * tol && q.x < ref.x1 - 2 * tol && q.y > ref.y0 + 2 * tol && q.y < ref.y1 - 2 * tol;
+        };
+        auto vertex_corner = [&ref](int c, std::size_t k) {
+            const std::span<const int> across = ref.cell_across(c);
+            return across[k] >= 0 && across[(k + across.size() - 1) % across.size()] >= 0;
+        };
+        for (std::size_t i = 0; i < corners.size();) {
+            const int c = corners[i].first;
+            std::size_t j = i;
+            while (j < corners.size() && corners[j].first == c) ++j;
+            const std::span<const Point> cell = ref.cell(c);
+            for (std::size_t v = i; v < j; ++v) {
+                const Point& q = d.vertices[corners[v].second].p;
+                if (!inside(q)) continue;
+                double best = std::numeric_limits<double>::infinity();
+                for (std::size_t k = 0; k < cell.size(); ++k) {
+                    if (vertex_corner(c, k)) best = std::min(best, distance(q, cell[k]));
+                }
+                note(best, tol, r.bad_vertices);
+            }
+            for (std::size_t k = 0; k < cell.size(); ++k) {
+                if (!vertex_corner(c, k) || !inside(cell[k])) continue;
+                double best = std::numeric_limits<double>::infinity();
+                for (std::size_t v = i; v < j; ++v) best = std::min(best, distance(cell[k], d.vertices[corners[v].second].p));
+                note(best, tol, r.bad_vertices);
+            }
+            i = j;
+        }
+        // Owners whose cell has corners but that the diagram gave none
+        std::vector<char> seen(n, 0);
+        for (const auto& [c, v] : corners) seen[c] = 1;
+        for (int c : by_x) {
+            if (seen[c]) continue;
+            for (std::size_t k = 0; k < ref.cell(c).size(); ++k) {
+                if (vertex_corner(c, k) && inside(ref.cell(c)[k])) {
+                    note(std::numeric_limits<double>::infinity(), tol, r.bad_vertices);
+                }
+            }
+        }
+    }
+
+    // Every pair's length in the box, allowing a tolerance per piece
+    for (const auto& [key, p] : pairs) {
+        if (p.reference > 2 * tol) ++r.edges;
+        note(std::abs(p.segments - p.reference), 2 * tol * (1 + p.segment_pieces), r.bad_edges);
+        if (mode == SweepMode::serial) note(std::abs(p.diagram - p.reference), 2 * tol * (1 + p.diagram_pieces), r.bad_edges);
+    }
+    return r;
+}
+
+template void reference_cells(std::span<const Point>, ReferenceCells&);
+template void reference_cells(std::span<const PointF>, ReferenceCells&);
+template void reference_cells(std::span<const PointI>, ReferenceCells&);
+template ReferenceCheck check_against_reference(std::span<const Point>, const ReferenceCells&, SweepMode,
+                                                const CheckOptions&);
+template ReferenceCheck check_against_reference(std::span<const PointF>, const ReferenceCells&, SweepMode,
+                                                const CheckOptions&);
+template ReferenceCheck check_against_reference(std::span<const PointI>, const ReferenceCells&, SweepMode,
+                                                const CheckOptions&);
+
+} // namespace Voronoi
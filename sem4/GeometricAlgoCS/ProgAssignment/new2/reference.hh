@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "point.hh"
+
+namespace Voronoi {
+
+// Slow reference for checking the sweep: every cell is cut out of a box
+// by the bisectors with all other sites, one half-plane at a time, which
+// is O(n^2) but has nothing in common with the sweep beyond the geometry.
+// Of equal sites the first one owns the cell. Corners where two bisectors
+// meet are recomputed as circumcenters in long double, so they are good
+// to a few ulps wherever the three sites are not nearly collinear.
+struct ReferenceCells {
+    double x0 = 0.0, y0 = 0.0, x1 = 0.0, y1 = 0.0; // The box
+    std::vector<int> owner; // Per site: the first site equal to it
+    // Cell of owner s, counterclockwise: corners[offsets[s]] up to
+    // corners[offsets[s + 1]], the site across the edge starting at each
+    // corner in across (-1 along the box). Empty for sites that are not
+    // owners.
+    std::vector<Point> corners;
+    std::vector<int> across;
+    std::vector<std::size_t> offsets;
+    double build_ms = 0.0;
+
+    std::size_t size() const { return owner.size(); }
+    std::span<const Point> cell(int s) const {
+        return std::span<const Point>(corners).subspan(offsets[s], offsets[s + 1] - offsets[s]);
+    }
+    std::span<const int> cell_across(int s) const {
+        return std::span<const int>(across).subspan(offsets[s], offsets[s + 1] - offsets[s]);
+    }
+};
+
+// The cells of sites in their bounding box grown by its larger side (at
+// least 1) on every side, replacing out's contents
+template <typename T>
+void reference_cells(std::span<const BasicPoint<T>> sites, ReferenceCells& out);
+
+// Ways of running the sweep that check_against_reference knows
+enum class SweepMode {
+    serial,    // compute() with the diagram
+    parallel,  // compute_parallel()
+    stream,    // compute_stream() on a sorted copy, into an edge sink
+    pipelined, // compute_pipelined()
+    // The file runs of external.hh: sites written to a temporary file,
+    // segments read back from the segment-chunks file
+    out_of_core,    // compute_out_of_core(), sorting in several runs
+    file_pipelined, // compute_file_pipelined()
+};
+
+const char* sweep_mode_name(SweepMode mode);
+
+struct CheckOptions {
+    // Largest deviation accepted; 0 picks one from the coordinate type and
+    // the size of the box: 1e-9 of it for double, 1e-6 for float, and a
+    // grid step for int32_t, whose segment ends are rounded
+    double tolerance = 0.0;
+    int repeats = 1; // Sweeps timed, the fastest reported
+    unsigned threads = std::thread::hardware_concurrency();
+};
+
+// What check_against_reference found. Every count but edges and segments
+// is a mismatch.
+struct ReferenceCheck {
+    std::size_t sites = 0;    // Owners, i.e. distinct sites
+    std::size_t edges = 0;    // Site pairs with an edge in the box, in the reference
+    std::size_t segments = 0; // Segments of the sweep reaching the box
+    std::size_t bad_links = 0;    // Half-edges whose twin, next or prev do not fit
+    std::size_t bad_faces = 0;    // Owners without a face, or with more than one
+    std::size_t bad_vertices = 0; // Vertices without a counterpart in the other diagram
+    std::size_t bad_edges = 0;    // Site pairs whose edge is longer or shorter than in the reference
+    std::size_t bad_segments = 0; // Segment points off the bisector of their two nearest sites
+    double worst = 0.0;           // Largest deviation seen, flagged or not
+    double tolerance = 0.0;
+    double sweep_ms = 0.0;
+    double reference_ms = 0.0;
+
+    bool ok() const {
+        return bad_links == 0 && bad_faces == 0 && bad_vertices == 0 && bad_edges == 0 && bad_segments == 0;
+    }
+};
+
+// Runs sites through the sweep in the given mode, with the reference's
+// box as clip rectangle, and compares the result with the reference built
+// from the same sites. Every mode has its segments checked: each piece is
+// given to the two sites nearest its middle, must keep to their bisector,
+// and the pieces of every pair must add up to the length of the
+// reference's edge. The serial mode also has its half-edge diagram
+// checked: the links, a face for each owner, every vertex in the box
+// against the corners of its cells both ways, and the length in the box
+// of every edge.
+template <typename T>
+ReferenceCheck check_against_reference(std::span<const BasicPoint<T>> sites, const ReferenceCells& reference,
+                                       SweepMode mode, const CheckOptions& options = {});
+
+} // namespace Voronoi
@@ -0,0 +1,412 @@
+#include "site_index.hh"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <thread>
+
+// AVX2 is looked for at run time; AVX-512 is used only in builds that
+// target it (-mavx512f or -march=native on such a CPU)
+#if defined(__x86_64__)
+#define VORONOI_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Voronoi {
+
+namespace {
+
+// Queries per batched traversal; one AVX-512 register pair or AVX2 quad
+constexpr std::size_t packet = 16;
+
+// A packet of queries in structure-of-arrays form. Site positions are kept
+// as doubles so they can be blended together with the distances. Unused
+// lanes have best = -inf, which keeps them out of every comparison.
+struct Packet {
+    alignas(64) double qx[packet];
+    alignas(64) double qy[packet];
+    alignas(64) double best[packet];
+    alignas(64) double best_k[packet];
+};
+
+// The lane kernels: reaches is true if any lane of the packet is closer
+// to the box than its best site, scan tests every lane against the sites
+// in [begin, end)
+struct ScalarLanes {
+    static bool reaches(const Packet& pk, double x0, double y0, double x1, double y1) {
+        for (std::size_t j = 0; j < packet; ++j) {
+            const double dx = std::max({x0 - pk.qx[j], 0.0, pk.qx[j] - x1});
+            const double dy = std::max({y0 - pk.qy[j], 0.0, pk.qy[j] - y1});
+            if (dx * dx + dy * dy < pk.best[j]) return true;
+        }
+        return false;
+    }
+    static void scan(Packet& pk, const double* xs, const double* ys, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t k = begin; k < end; ++k) {
+            for (std::size_t j = 0; j < packet; ++j) {
+                const double dx = xs[k] - pk.qx[j], dy = ys[k] - pk.qy[j];
+                const double d = dx * dx + dy * dy;
+                if (d < pk.best[j]) {
+                    pk.best[j] = d;
+                    pk.best_k[j] = static_cast<double>(k);
+                }
+            }
+        }
+    }
+};
+
+#if defined(__AVX512F__)
+struct Avx512Lanes {
+    static bool reaches(const Packet& pk, double x0, double y0, double x1, double y1) {
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d bx0 = _mm512_set1_pd(x0), by0 = _mm512_set1_pd(y0);
+        const __m512d bx1 = _mm512_set1_pd(x1), by1 = _mm512_set1_pd(y1);
+        for (std::size_t j = 0; j < packet; j += 8) {
+            const __m512d qx = _mm512_load_pd(pk.qx + j), qy = _mm512_load_pd(pk.qy + j);
+            const __m512d dx = _mm512_max_pd(_mm512_max_pd(_mm512_sub_pd(bx0, qx), _mm512_sub_pd(qx, bx1)), zero);
+            const __m512d dy = _mm512_max_pd(_mm512_max_pd(_mm512_sub_pd(by0, qy), _mm512_sub_pd(qy, by1)), zero);
+            const __m512d d = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+            if (_mm512_cmp_pd_mask(d, _mm512_load_pd(pk.best + j), _CMP_LT_OQ)) return true;
+        }
+        return false;
+    }
+    static void scan(Packet& pk, const double* xs, const double* ys, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t k = begin; k < end; ++k) {
+            const __m512d sx = _mm512_set1_pd(xs[k]), sy = _mm512_set1_pd(ys[k]);
+            const __m512d sk = _mm512_set1_pd(static_cast<double>(k));
+            for (std::size_t j = 0; j < packet; j += 8) {
+                const __m512d dx = _mm512_sub_pd(sx, _mm512_load_pd(pk.qx + j));
+                const __m512d dy = _mm512_sub_pd(sy, _mm512_load_pd(pk.qy + j));
+                const __m512d d = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+                const __m512d best = _mm512_load_pd(pk.best + j);
+                const __mmask8 better = _mm512_cmp_pd_mask(d, best, _CMP_LT_OQ);
+                _mm512_store_pd(pk.best + j, _mm512_mask_blend_pd(better, best, d));
+                _mm512_store_pd(pk.best_k + j, _mm512_mask_blend_pd(better, _mm512_load_pd(pk.best_k + j), sk));
+            }
+        }
+    }
+};
+#endif
+
+#if defined(VORONOI_X86) && !defined(__AVX512F__)
+struct Avx2Lanes {
+    __attribute__((target("avx2")))
+    static bool reaches(const Packet& pk, double x0, double y0, double x1, double y1) {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d bx0 = _mm256_set1_pd(x0), by0 = _mm256_set1_pd(y0);
+        const __m256d bx1 = _mm256_set1_pd(x1), by1 = _mm256_set1_pd(y1);
+        for (std::size_t j = 0; j < packet; j += 4) {
+            const __m256d qx = _mm256_load_pd(pk.qx + j), qy = _mm256_load_pd(pk.qy + j);
+            const __m256d dx = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(bx0, qx), _mm256_sub_pd(qx, bx1)), zero);
+            const __m256d dy = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(by0, qy), _mm256_sub_pd(qy, by1)), zero);
+            const __m256d d = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            if (_mm256_movemask_pd(_mm256_cmp_pd(d, _mm256_load_pd(pk.best + j), _CMP_LT_OQ))) return true;
+        }
+        return false;
+    }
+    __attribute__((target("avx2")))
+    static void scan(Packet& pk, const double* xs, const double* ys, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t k = begin; k < end; ++k) {
+            const __m256d sx = _mm256_set1_pd(xs[k]), sy = _mm256_set1_pd(ys[k]);
+            const __m256d sk = _mm256_set1_pd(static_cast<double>(k));
+            for (std::size_t j = 0; j < packet; j += 4) {
+                const __m256d dx = _mm256_sub_pd(sx, _mm256_load_pd(pk.qx + j));
+                const __m256d dy = _mm256_sub_pd(sy, _mm256_load_pd(pk.qy + j));
+                const __m256d d = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+                const __m256d best = _mm256_load_pd(pk.best + j);
+                const __m256d better = _mm256_cmp_pd(d, best, _CMP_LT_OQ);
+                _mm256_store_pd(pk.best + j, _mm256_blendv_pd(best, d, better));
+                _mm256_store_pd(pk.best_k + j, _mm256_blendv_pd(_mm256_load_pd(pk.best_k + j), sk, better));
+            }
+        }
+    }
+};
+#endif
+
+// Loads qs into the packet and walks the tree with it: a node is entered
+// if any lane can still improve on it, and leaves are scanned with lanes =
+// queries. Children are visited near side first, as seen from the middle
+// query.
+template <typename Lanes, typename Node>
+inline __attribute__((always_inline))
+void walk(const std::vector<Node>& nodes, const double* xs, const double* ys, std::span<const Point> qs, Packet& pk) {
+    for (std::size_t j = 0; j < packet; ++j) {
+        const bool used = j < qs.size();
+        pk.qx[j] = used ? qs[j].x : 0.0;
+        pk.qy[j] = used ? qs[j].y : 0.0;
+        pk.best[j] = used ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+        pk.best_k[j] = 0.0;
+    }
+    const Point& probe = qs[qs.size() / 2];
+    
+    std::size_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!Lanes::reaches(pk, node.x0, node.y0, node.x1, node.y1)) continue;
+        
+        if (node.axis < 0) {
+            Lanes::scan(pk, xs, ys, node.begin, node.end);
+            continue;
+        }
+        const std::size_t i = static_cast<std::size_t>(&node - nodes.data());
+        const bool low_first = (node.axis == 0 ? probe.x : probe.y) < node.split;
+        stack[top++] = low_first ? 2 * i + 2 : 2 * i + 1;
+        stack[top++] = low_first ? 2 * i + 1 : 2 * i + 2;
+    }
+}
+
+#if defined(VORONOI_X86) && !defined(__AVX512F__)
+// The AVX2 walk as a function of its own, so the kernels inline into it
+template <typename Node>
+__attribute__((target("avx2")))
+void walk_avx2(const std::vector<Node>& nodes, const double* xs, const double* ys, std::span<const Point> qs, Packet& pk) {
+    walk<Avx2Lanes>(nodes, xs, ys, qs, pk);
+}
+
+// Chosen once, on the first call
+bool use_avx2() {
+    static const bool avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return avx2;
+}
+#endif
+
+} // namespace
+
+template <typename T>
+void SiteIndex::build(std::span<const BasicPoint<T>> sites, unsigned threads) {
+    const std::size_t n = sites.size();
+    nodes.clear();
+    xs.resize(n);
+    ys.resize(n);
+    ids.resize(n);
+    if (n == 0) return;
+    
+    // Depth at which median splits bring every leaf down to leaf_size
+    int depth = 0;
+    while (((n - 1) >> depth) + 1 > leaf_size) ++depth;
+    nodes.resize((std::size_t(2) << depth) - 1);
+    
+    // ids is partitioned in place into leaf order
+    for (std::size_t i = 0; i < n; ++i) ids[i] = static_cast<std::uint32_t>(i);
+    build_node(0, 0, static_cast<std::uint32_t>(n), sites, ids, std::max(threads, 1u));
+    
+    for (std::size_t k = 0; k < n; ++k) {
+        xs[k] = sites[ids[k]].x;
+        ys[k] = sites[ids[k]].y;
+    }
+}
+
+template <typename T>
+void SiteIndex::build_node(std::size_t i, std::uint32_t begin, std::uint32_t end,
+                           std::span<const BasicPoint<T>> sites, std::vector<std::uint32_t>& order,
+                           unsigned threads) {
+    Node& node = nodes[i];
+    node.begin = begin;
+    node.end = end;
+    node.axis = -1;
+    node.split = 0.0;
+    
+    double x0 = std::numeric_limits<double>::infinity(), x1 = -x0;
+    double y0 = x0, y1 = x1;
+    for (std::uint32_t k = begin; k < end; ++k) {
+        const Point p = sites[order[k]];
+        x0 = std::min(x0, p.x);
+        x1 = std::max(x1, p.x);
+        y0 = std::min(y0, p.y);
+        y1 = std::max(y1, p.y);
+    }
+    node.x0 = x0;
+    node.y0 = y0;
+    node.x1 = x1;
+    node.y1 = y1;
+    if (2 * i + 1 >= nodes.size()) return;
+    
+    // Split the wider side of the bounding box at the median
+    const int axis = (x1 - x0 >= y1 - y0) ? 0 : 1;
+    const std::uint32_t mid = begin + (end - begin) / 2;
+    auto coord = [&](std::uint32_t s) -> double { return axis == 0 ? sites[s].x : sites[s].y; };
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&](std::uint32_t a, std::uint32_t b) { return coord(a) < coord(b); });
+    
+    node.axis = axis;
+    node.split = mid < end ? coord(order[mid]) : 0.0;
+    
+    // Subtrees touch disjoint nodes and ranges of order
+    if (threads > 1) {
+        std::thread high([&, i, mid, end] { build_node(2 * i + 2, mid, end, sites, order, threads - threads / 2); });
+        build_node(2 * i + 1, begin, mid, sites, order, threads / 2);
+        high.join();
+    } else {
+        build_node(2 * i + 1, begin, mid, sites, order, 1);
+        build_node(2 * i + 2, mid, end, sites, order, 1);
+    }
+}
+
+template void SiteIndex::build(std::span<const Point>, unsigned);
+template void SiteIndex::build(std::span<const PointF>, unsigned);
+template void SiteIndex::build(std::span<const PointI>, unsigned);
+
+void SiteIndex::clear() {
+    nodes.clear();
+    xs.clear();
+    ys.clear();
+    ids.clear();
+}
+
+void SiteIndex::reserve(std::size_t n) {
+    std::size_t leaves = 1;
+    while (leaves * leaf_size < n) leaves *= 2;
+    nodes.reserve(2 * leaves - 1);
+    xs.reserve(n);
+    ys.reserve(n);
+    ids.reserve(n);
+}
+
+int SiteIndex::nearest(const Point& q) const {
+    if (ids.empty()) return -1;
+    return static_cast<int>(ids[search(q, std::numeric_limits<double>::infinity(), 0)]);
+}
+
+void SiteIndex::nearest(std::span<const Point> queries, std::span<int> out) const {
+    assert(out.size() >= queries.size());
+    if (ids.empty()) {
+        std::fill(out.begin(), out.begin() + queries.size(), -1);
+        return;
+    }
+    
+    Packet pk;
+    for (std::size_t first = 0; first < queries.size(); first += packet) {
+        const std::size_t m = std::min(packet, queries.size() - first);
+        if (!coherent(queries.subspan(first, m))) {
+            for (std::size_t j = 0; j < m; ++j) {
+                out[first + j] = static_cast<int>(ids[search(queries[first + j], std::numeric_limits<double>::infinity(), 0)]);
+            }
+            continue;
+        }
+        
+#if defined(__AVX512F__)
+        walk<Avx512Lanes>(nodes, xs.data(), ys.data(), queries.subspan(first, m), pk);
+#elif defined(VORONOI_X86)
+        if (use_avx2()) {
+            walk_avx2(nodes, xs.data(), ys.data(), queries.subspan(first, m), pk);
+        } else {
+            walk<ScalarLanes>(nodes, xs.data(), ys.data(), queries.subspan(first, m), pk);
+        }
+#else
+        walk<ScalarLanes>(nodes, xs.data(), ys.data(), queries.subspan(first, m), pk);
+#endif
+        
+        for (std::size_t j = 0; j < m; ++j) {
+            out[first + j] = static_cast<int>(ids[static_cast<std::uint32_t>(pk.best_k[j])]);
+        }
+    }
+}
+
+void SiteIndex::in_box(double x0, double y0, double x1, double y1, std::vector<std::uint32_t>& out) const {
+    if (ids.empty()) return;
+    std::size_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const std::size_t i = stack[--top];
+        const Node& node = nodes[i];
+        // Empty nodes have an inverted box and are never entered
+        if (node.x1 < x0 || node.x0 > x1 || node.y1 < y0 || node.y0 > y1) continue;
+        
+        if (node.x0 >= x0 && node.x1 <= x1 && node.y0 >= y0 && node.y1 <= y1) {
+            out.insert(out.end(), ids.begin() + node.begin, ids.begin() + node.end);
+            continue;
+        }
+        if (node.axis < 0) {
+            for (std::uint32_t k = node.begin; k < node.end; ++k) {
+                if (xs[k] >= x0 && xs[k] <= x1 && ys[k] >= y0 && ys[k] <= y1) out.push_back(ids[k]);
+            }
+            continue;
+        }
+        stack[top++] = 2 * i + 1;
+        stack[top++] = 2 * i + 2;
+    }
+}
+
+std::uint32_t SiteIndex::search(const Point& q, double best, std::uint32_t best_k) const {
+    // Far children waiting to be visited, with a lower bound on their distance
+    struct Pending {
+        std::size_t node;
+        double bound;
+    };
+    Pending stack[64];
+    int top = 0;
+    stack[top++] = {0, 0.0};
+    
+    while (top > 0) {
+        const Pending item = stack[--top];
+        if (item.bound >= best) continue;
+        
+        std::size_t i = item.node;
+        bool reached_leaf = true;
+        while (nodes[i].axis >= 0) {
+            const double diff = (nodes[i].axis == 0 ? q.x : q.y) - nodes[i].split;
+            const std::size_t near = diff < 0 ? 2 * i + 1 : 2 * i + 2;
+            const std::size_t far = diff < 0 ? 2 * i + 2 : 2 * i + 1;
+            const double bound = box_distance(nodes[far], q);
+            if (bound < best) stack[top++] = {far, bound};
+            if (box_distance(nodes[near], q) >= best) {
+                reached_leaf = false;
+                break;
+            }
+            i = near;
+        }
+        
+        if (reached_leaf) {
+            for (std::uint32_t k = nodes[i].begin; k < nodes[i].end; ++k) {
+                const double dx = xs[k] - q.x, dy = ys[k] - q.y;
+                const double d = dx * dx + dy * dy;
+                if (d < best) {
+                    best = d;
+                    best_k = k;
+                }
+            }
+        }
+    }
+    return best_k;
+}
+
+// A packet is worth traversing together when the tree keeps its queries on
+// one side of every split down to a small subtree; scattered packets would
+// otherwise drag every lane through most of the tree.
+bool SiteIndex::coherent(std::span<const Point> qs) const {
+    double x0 = qs[0].x, x1 = x0, y0 = qs[0].y, y1 = y0;
+    for (const Point& q : qs) {
+        x0 = std::min(x0, q.x);
+        x1 = std::max(x1, q.x);
+        y0 = std::min(y0, q.y);
+        y1 = std::max(y1, q.y);
+    }
+    
+    std::size_t i = 0;
+    while (nodes[i].axis >= 0 && nodes[i].end - nodes[i].begin > coherent_sites) {
+        const double lo = nodes[i].axis == 0 ? x0 : y0;
+        const double hi = nodes[i].axis == 0 ? x1 : y1;
+        if (hi < nodes[i].split) {
+            i = 2 * i + 1;
+        } else if (lo >= nodes[i].split) {
+            i = 2 * i + 2;
+        } else {
+            break;
+        }
+    }
+    return nodes[i].end - nodes[i].begin <= coherent_sites;
+}
+
+// Squared distance from q to the node's bounding box
+double SiteIndex::box_distance(const Node& node, const Point& q) const {
+    const double dx = std::max({node.x0 - q.x, 0.0, q.x - node.x1});
+    const double dy = std::max({node.y0 - q.y, 0.0, q.y - node.y1});
+    return dx * dx + dy * dy;
+}
+
+} // namespace Voronoi
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "point.hh"
+
+namespace Voronoi {
+
+// Static kd-tree over a fixed site set. Sites are stored in leaf order as
+// parallel x/y/id arrays, so every leaf is one contiguous run of at most
+// leaf_size sites. Nearest-site queries take O(log n) on any distribution
+// and never allocate.
+class SiteIndex {
+public:
+    static constexpr std::uint32_t leaf_size = 8;
+    
+    // Subtrees near the root are built on up to threads threads. Sites may
+    // have any of the coordinate types of BasicFortuneAlgorithm.
+    template <typename T>
+    void build(std::span<const BasicPoint<T>> sites, unsigned threads = 1);
+    void build(std::span<const Point> sites, unsigned threads = 1) { build<double>(sites, threads); }
+    
+    bool empty() const { return ids.empty(); }
+    // Drop the sites, keeping the storage for the next build
+    void clear();
+    void reserve(std::size_t n);
+    
+    // Index of the site closest to q, or -1 when there are no sites
+    int nearest(const Point& q) const;
+    
+    // nearest() for every query; out must hold queries.size() entries.
+    // Queries go through the tree in packets, so spatially coherent batches
+    // (raster scans) share most of the traversal.
+    void nearest(std::span<const Point> queries, std::span<int> out) const;
+    
+    // Appends the indices of the sites in [x0, x1] x [y0, y1] to out, in
+    // no particular order
+    void in_box(double x0, double y0, double x1, double y1, std::vector<std::uint32_t>& out) const;
+    
+private:
+    // Children of node i are 2i+1 and 2i+2; all leaves sit at the same depth
+    struct Node {
+        double x0, y0, x1, y1;    // Bounding box of the node's sites
+        double split;
+        std::uint32_t begin, end; // Range in the site arrays
+        int axis;                 // 0 = x, 1 = y, -1 = leaf
+    };
+    
+    // Largest subtree a packet of queries may span and still go through
+    // the tree together
+    static constexpr std::uint32_t coherent_sites = 256;
+    
+    std::vector<Node> nodes;
+    std::vector<double> xs, ys; // Site coordinates in leaf order
+    std::vector<std::uint32_t> ids;
+    
+    // Position in the site arrays of the site nearest q, given that the
+    // site at best_k lies at squared distance best
+    std::uint32_t search(const Point& q, double best, std::uint32_t best_k) const;
+    bool coherent(std::span<const Point> qs) const;
+    double box_distance(const Node& node, const Point& q) const;
+    template <typename T>
+    void build_node(std::size_t i, std::uint32_t begin, std::uint32_t end,
+                    std::span<const BasicPoint<T>> sites, std::vector<std::uint32_t>& order,
+                    unsigned threads);
+};
+
+} // namespace Voronoi
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "cells.hh"
+#include "diagram.hh"
+#include "point.hh"
+#include "site_index.hh"
+
+namespace Voronoi {
+
+template <typename T, typename Geometry>
+class BasicFortuneAlgorithm;
+
+// What the queries of BasicFortuneAlgorithm read, copied out of it by
+// snapshot() after a compute() (and any edits): the sites, the half-edge
+// diagram if it was built, and the nearest-site index. Nothing changes it
+// afterwards, so it can be queried from any number of threads while the
+// algorithm goes on to the next compute().
+template <typename T>
+class BasicSnapshot {
+public:
+    using Site = BasicPoint<T>;
+    
+    std::span<const Site> get_sites() const { return sites; }
+    const Diagram& get_diagram() const { return diagram; }
+    
+    // As in BasicFortuneAlgorithm; the neighbour queries need the diagram
+    int locate_cell(const Point& q) const { return cells().locate(q); }
+    void locate_cells(std::span<const Point> queries, std::span<int> out) const { cells().locate(queries, out); }
+    void nearest_k(const Point& q, std::size_t k, std::vector<int>& out, NeighborScratch& scratch) const {
+        cells().nearest_k(q, k, out, scratch);
+    }
+    void within_radius(const Point& q, double r, std::vector<int>& out, NeighborScratch& scratch) const {
+        cells().within_radius(q, r, out, scratch);
+    }
+    
+private:
+    template <typename, typename> friend class BasicFortuneAlgorithm;
+    
+    std::vector<Site> sites;
+    Diagram diagram;
+    SiteIndex index;
+    std::vector<std::pair<int, int>> duplicates;
+    std::vector<char> removed;
+    std::vector<int> moved_to;
+    
+    CellView<T> cells() const { return {sites, diagram, index, duplicates, removed, moved_to}; }
+};
+
+using Snapshot = BasicSnapshot<double>;
+using SnapshotF = BasicSnapshot<float>;
+using SnapshotI = BasicSnapshot<std::int32_t>;
+
+// The current snapshot of a service that rebuilds while it answers
+// queries. Readers never lock and never wait: each reading thread holds a
+// Reader, and a read announces the epoch it started in, in the Reader's
+// slot, before it loads the current snapshot. publish() swaps in the new
+// snapshot and bumps the epoch; the old one is freed, by a later publish()
+// or reclaim(), once every slot is idle or has announced a later epoch,
+// since a read that started after the swap can only find the new one.
+// publish() and reclaim() may be called from any thread; they serialize
+// among themselves only.
+template <typename S>
+class Publisher {
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{0}; // Of the read in progress, 0 when idle
+        std::atomic<bool> taken{false};
+    };
+    
+public:
+    static constexpr std::size_t max_readers = 64;
+    
+    // A snapshot being read: valid for as long as the guard lives
+    class Guard {
+    public:
+        Guard(Guard&& o) noexcept : slot(std::exchange(o.slot, nullptr)), s(o.s) {}
+        Guard& operator=(Guard&&) = delete;
+        ~Guard() {
+            if (slot) slot->epoch.store(0, std::memory_order_release);
+        }
+        
+        const S& operator*() const { return *s; }
+        const S* operator->() const { return s; }
+        const S* get() const { return s; }
+        // False before the first publish()
+        explicit operator bool() const { return s != nullptr; }
+        
+    private:
+        friend class Publisher;
+        Slot* slot;
+        const S* s;
+        
+        Guard(Slot* slot, const S* s) : slot(slot), s(s) {}
+    };
+    
+    // A reading thread's slot. A Reader is used by one thread at a time,
+    // with at most one Guard alive.
+    class Reader {
+    public:
+        Reader(Reader&& o) noexcept : pub(o.pub), slot(std::exchange(o.slot, nullptr)) {}
+        Reader& operator=(Reader&&) = delete;
+        ~Reader() {
+            if (slot) slot->taken.store(false, std::memory_order_release);
+        }
+        
+        Guard read() const {
+            slot->epoch.store(pub->epoch.load(), std::memory_order_seq_cst);
+            return Guard(slot, pub->current.load(std::memory_order_seq_cst));
+        }
+        
+    private:
+        friend class Publisher;
+        const Publisher* pub;
+        Slot* slot;
+        
+        Reader(const Publisher* pub, Slot* slot) : pub(pub), slot(slot) {}
+    };
+    
+    Publisher() = default;
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+    // Needs every Reader gone
+    ~Publisher() {
+        delete current.load();
+        for (const auto& r : retired) delete r.second;
+    }
+    
+    // Takes a free slot; throws std::length_error if all max_readers are taken
+    Reader reader() {
+        for (Slot& slot : slots) {
+            bool taken = false;
+            if (slot.taken.compare_exchange_strong(taken, true, std::memory_order_acquire)) return Reader(this, &slot);
+        }
+        throw std::length_error("too many snapshot readers");
+    }
+    
+    // Makes s the snapshot every read from now on finds, then frees what
+    // no read can reach anymore
+    void publish(std::unique_ptr<const S> s) {
+        std::lock_guard<std::mutex> lock(writer);
+        const S* old = current.exchange(s.release(), std::memory_order_seq_cst);
+        const std::uint64_t e = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        if (old) retired.push_back({e, old});
+        collect();
+    }
+    
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(writer);
+        collect();
+    }
+    
+    // Snapshots replaced but not yet freed
+    std::size_t pending() const {
+        std::lock_guard<std::mutex> lock(writer);
+        return retired.size();
+    }
+    
+private:
+    std::array<Slot, max_readers> slots;
+    std::atomic<const S*> current{nullptr};
+    std::atomic<std::uint64_t> epoch{1};
+    mutable std::mutex writer;
+    std::vector<std::pair<std::uint64_t, const S*>> retired; // Epoch of the swap, old snapshot
+    
+    void collect() {
+        // Oldest epoch a read in progress may have started in
+        std::uint64_t oldest = UINT64_MAX;
+        for (const Slot& slot : slots) {
+            const std::uint64_t e = slot.epoch.load(std::memory_order_seq_cst);
+            if (e != 0 && e < oldest) oldest = e;
+        }
+        std::size_t kept = 0;
+        for (const auto& r : retired) {
+            if (r.first <= oldest) {
+                delete r.second;
+            } else {
+                retired[kept++] = r;
+            }
+        }
+        retired.resize(kept);
+    }
+};
+
+using SnapshotPublisher = Publisher<Snapshot>;
+
+} // namespace Voronoi
@@ -0,0 +1,104 @@
+#pragma once
+
+// Sweep instrumentation. Build with -DVORONOI_STATS to collect it; without
+// the flag the hooks below expand to nothing and SweepStats is not declared.
+#ifdef VORONOI_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Voronoi {
+
+struct SweepStats {
+    // Wall time per phase, in seconds
+    double process_point_time = 0.0;
+    double process_event_time = 0.0;
+    double finish_edges_time = 0.0;
+    
+    std::uint64_t sites = 0;
+    std::uint64_t arcs_visited = 0;     // Beach-line nodes passed by front_insert
+    std::uint64_t max_arcs_visited = 0; // Most nodes passed by a single insert
+    std::uint64_t intersections = 0;    // Breakpoint solves
+    
+    std::uint64_t circle_events_created = 0;
+    std::uint64_t circle_events_invalidated = 0;
+    std::uint64_t circle_events_executed = 0;
+    
+    std::uint64_t max_beach_length = 0;
+    std::uint64_t max_heap_size = 0;
+    
+    // Levels of the 4-ary event heap at its largest
+    std::uint64_t max_heap_depth() const {
+        std::uint64_t depth = 0;
+        for (std::uint64_t level = 1, total = 0; total < max_heap_size; level *= 4, ++depth) total += level;
+        return depth;
+    }
+    
+    // Accumulates another run, e.g. one cell of compute_parallel
+    void add(const SweepStats& o) {
+        process_point_time += o.process_point_time;
+        process_event_time += o.process_event_time;
+        finish_edges_time += o.finish_edges_time;
+        sites += o.sites;
+        arcs_visited += o.arcs_visited;
+        max_arcs_visited = std::max(max_arcs_visited, o.max_arcs_visited);
+        intersections += o.intersections;
+        circle_events_created += o.circle_events_created;
+        circle_events_invalidated += o.circle_events_invalidated;
+        circle_events_executed += o.circle_events_executed;
+        max_beach_length = std::max(max_beach_length, o.max_beach_length);
+        max_heap_size = std::max(max_heap_size, o.max_heap_size);
+    }
+    
+    std::string to_json() const {
+        std::string out = "{";
+        auto field = [&out](const char* name, const std::string& value) {
+            if (out.size() > 1) out += ", ";
+            out += '"';
+            out += name;
+            out += "\": ";
+            out += value;
+        };
+        field("process_point_time", std::to_string(process_point_time));
+        field("process_event_time", std::to_string(process_event_time));
+        field("finish_edges_time", std::to_string(finish_edges_time));
+        field("sites", std::to_string(sites));
+        field("arcs_visited", std::to_string(arcs_visited));
+        field("max_arcs_visited", std::to_string(max_arcs_visited));
+        field("intersections", std::to_string(intersections));
+        field("circle_events_created", std::to_string(circle_events_created));
+        field("circle_events_invalidated", std::to_string(circle_events_invalidated));
+        field("circle_events_executed", std::to_string(circle_events_executed));
+        field("max_beach_length", std::to_string(max_beach_length));
+        field("max_heap_size", std::to_string(max_heap_size));
+        field("max_heap_depth", std::to_string(max_heap_depth()));
+        return out + "}";
+    }
+};
+
+// Adds the lifetime of the enclosing scope to a phase time
+class PhaseTimer {
+public:
+    explicit PhaseTimer(double& total) : total(total), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+private:
+    double& total;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace Voronoi
+
+#define VORONOI_STAT(statement) statement
+#define VORONOI_PHASE(field) ::Voronoi::PhaseTimer phase_timer_(sweep_stats.field)
+
+#else
+
+#define VORONOI_STAT(statement)
+#define VORONOI_PHASE(field)
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+namespace Voronoi {
+
+// Delaunay triangulation dual to the Voronoi diagram, as an indexed
+// triangle list. Triangles come one per Voronoi vertex, in the order the
+// sweep reaches them. Corners are site indices in insertion order, in
+// counterclockwise order; adj[i] is the triangle across the edge opposite
+// corner i, or -1 on the convex hull. Cocircular sites give one triangle
+// per vertex the sweep found there, so they are split along some diagonal.
+struct Triangulation {
+    struct Triangle {
+        int v[3];
+        int adj[3];
+    };
+    
+    std::vector<Triangle> triangles;
+    
+    void clear() {
+        triangles.clear();
+    }
+};
+
+} // namespace Voronoi
@@ -0,0 +1,592 @@
+// Checks the sweep against the brute-force reference of reference.hh on
+// randomized and degenerate inputs, for every coordinate type and every
+// way of running it, the file runs of external.hh included, and times
+// both. Then checks what is built on the diagram against scans of the
+// sites: the neighbour queries, the windowed cells against the clipped
+// full diagram, and edits against a fresh sweep of the sites they leave.
+//
+//   g++ -std=c++20 -O2 -pthread verify.cpp reference.cpp voronoi.cpp site_index.cpp parallel.cpp incremental.cpp predicates.cpp lloyd.cpp batch.cpp cells.cpp window.cpp raster.cpp pipeline.cpp io.cpp external.cpp -o verify
+//   ./verify [max_sites [seeds]]
+//
+// Prints a line per input, size and type with the reference's time and
+// each mode's sweep time and verdict, then one per further check, and
+// exits with 1 if anything did not match, so a change to the sweep is
+// only worth its speed if this passes.
+#include "reference.hh"
+#include "voronoi.hh"
+#include "window.hh"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Voronoi::Point;
+using Voronoi::SweepMode;
+
+enum Input { uniform, clustered, grid, circle, line, columns, duplicates, near_line, offset };
+
+const char* const input_names[] = {"uniform", "clustered", "grid", "circle", "line",
+                                   "columns", "duplicates", "near_line", "offset"};
+
+std::vector<Point> make_sites(Input input, std::size_t n, std::uint64_t seed) {
+    std::mt19937_64 rng(seed * 1000003 + n);
+    std::uniform_real_distribution<double> u(0.0, 1000.0);
+    std::vector<Point> sites;
+    sites.reserve(n);
+
+    switch (input) {
+    case uniform:
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({u(rng), u(rng)});
+        break;
+    case clustered: {
+        // Tight blobs of about a hundred sites
+        std::normal_distribution<double> g(0.0, 0.5);
+        std::vector<Point> centres(std::max<std::size_t>(1, n / 100));
+        for (Point& c : centres) c = {u(rng), u(rng)};
+        for (std::size_t i = 0; i < n; ++i) {
+            const Point& c = centres[i % centres.size()];
+            sites.push_back({c.x + g(rng), c.y + g(rng)});
+        }
+        break;
+    }
+    case grid: {
+        // Every unit square has four cocircular corners
+        const std::size_t side = static_cast<std::size_t>(std::ceil(std::sqrt(double(n))));
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({double(i % side), double(i / side)});
+        std::shuffle(sites.begin(), sites.end(), rng);
+        break;
+    }
+    case circle:
+        // All on one circle but its center: every vertex of degree n
+        sites.push_back({500.0, 500.0});
+        for (std::size_t i = 1; i < n; ++i) {
+            const double a = 2 * M_PI * double(i) / double(n - 1);
+            sites.push_back({500.0 + 400.0 * std::cos(a), 500.0 + 400.0 * std::sin(a)});
+        }
+        break;
+    case line:
+        // Evenly spaced on a diagonal: only parallel edges, no vertices
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({3.0 * double(i), 2.0 * double(i)});
+        std::shuffle(sites.begin(), sites.end(), rng);
+        break;
+    case columns: {
+        // A few x values shared by many sites, so most keys tie
+        std::uniform_int_distribution<int> column(0, 7);
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({100.0 * column(rng), u(rng)});
+        break;
+    }
+    case duplicates:
+        // Every site two to four times
+        while (sites.size() < n) {
+            const Point p{u(rng), u(rng)};
+            for (std::size_t k = 2 + rng() % 3; k > 0 && sites.size() < n; --k) sites.push_back(p);
+        }
+        std::shuffle(sites.begin(), sites.end(), rng);
+        break;
+    case near_line: {
+        // Off a line by far less than the spacing
+        std::uniform_real_distribution<double> e(-1e-3, 1e-3);
+        for (std::size_t i = 0; i < n; ++i) {
+            const double t = u(rng);
+            sites.push_back({t, 0.5 * t + e(rng)});
+        }
+        break;
+    }
+    case offset:
+        // A small patch far from the origin
+        for (std::size_t i = 0; i < n; ++i) sites.push_back({1e5 + u(rng) / 1000, 2e5 + u(rng) / 1000});
+        break;
+    }
+    return sites;
+}
+
+// Sites as T; integer sites are scaled up first so the grid keeps them apart
+template <typename T>
+std::vector<Voronoi::BasicPoint<T>> as_type(const std::vector<Point>& sites) {
+    std::vector<Voronoi::BasicPoint<T>> out;
+    out.reserve(sites.size());
+    const double scale = std::is_integral_v<T> ? 1024.0 : 1.0;
+    for (const Point& p : sites) out.emplace_back(Point(p.x * scale, p.y * scale));
+    return out;
+}
+
+constexpr SweepMode modes[] = {SweepMode::serial, SweepMode::parallel, SweepMode::stream, SweepMode::pipelined,
+                               SweepMode::out_of_core, SweepMode::file_pipelined};
+
+struct Row {
+    double reference_ms = 0.0;
+    double sweep_ms[std::size(modes)] = {};
+    double worst[std::size(modes)] = {}; // Relative to the tolerance
+    bool ok[std::size(modes)] = {true, true, true, true, true, true};
+};
+
+template <typename T>
+void run(Input input, std::size_t n, unsigned seeds, const Voronoi::CheckOptions& options, Row& row) {
+    Voronoi::ReferenceCells reference;
+    for (unsigned seed = 0; seed < seeds; ++seed) {
+        const std::vector<Voronoi::BasicPoint<T>> sites = as_type<T>(make_sites(input, n, seed));
+        Voronoi::reference_cells<T>(sites, reference);
+        row.reference_ms += reference.build_ms / seeds;
+        for (std::size_t m = 0; m < std::size(modes); ++m) {
+            const Voronoi::ReferenceCheck c = Voronoi::check_against_reference<T>(sites, reference, modes[m], options);
+            row.sweep_ms[m] += c.sweep_ms / seeds;
+            row.worst[m] = std::max(row.worst[m], c.worst / c.tolerance);
+            if (!c.ok()) {
+                row.ok[m] = false;
+                std::printf("  %s n %zu seed %u %s: links %zu faces %zu vertices %zu edges %zu (of %zu) segments %zu "
+                            "(of %zu), worst %g, tolerance %g\n",
+                            input_names[input], n, seed, Voronoi::sweep_mode_name(modes[m]), c.bad_links, c.bad_faces,
+                            c.bad_vertices, c.bad_edges, c.edges, c.bad_segments, c.segments, c.worst, c.tolerance);
+            }
+        }
+    }
+}
+
+double dist2(const Point& a, const Point& b) {
+    const double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+// Distance from q to the boundary of a polygon
+double to_boundary(const Point& q, std::span<const Point> poly) {
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t k = 0; k < poly.size(); ++k) {
+        const Point& a = poly[k];
+        const Point& b = poly[(k + 1) % poly.size()];
+        const double dx = b.x - a.x, dy = b.y - a.y, l2 = dx * dx + dy * dy;
+        const double t = l2 > 0.0 ? std::clamp(((q.x - a.x) * dx + (q.y - a.y) * dy) / l2, 0.0, 1.0) : 0.0;
+        best = std::min(best, std::sqrt(dist2(q, {a.x + t * dx, a.y + t * dy})));
+    }
+    return best;
+}
+
+double area(std::span<const Point> poly) {
+    double a = 0.0;
+    for (std::size_t k = 0; k < poly.size(); ++k) {
+        const Point& p = poly[k];
+        const Point& q = poly[(k + 1) % poly.size()];
+        a += p.x * q.y - q.x * p.y;
+    }
+    return a / 2;
+}
+
+// Cells by the position of their site, so that equal sites compare
+// whichever of them owns the cell. Slivers thinner than tolerance are left
+// out: whether a cell that only touches the window is reported is open.
+using Cells = std::map<std::pair<double, double>, std::vector<Point>>;
+
+void add_cell(Cells& cells, const Point& site, std::vector<Point> poly, double tolerance) {
+    double perimeter = 0.0;
+    for (std::size_t k = 0; k < poly.size(); ++k) perimeter += std::sqrt(dist2(poly[k], poly[(k + 1) % poly.size()]));
+    if (std::abs(area(poly)) > tolerance * perimeter) cells[{site.x, site.y}] = std::move(poly);
+}
+
+// Largest distance of a corner of one cell from the boundary of the
+// other, or infinity if the cells are not of the same sites
+double cells_gap(const Cells& a, const Cells& b) {
+    if (a.size() != b.size()) return std::numeric_limits<double>::infinity();
+    double worst = 0.0;
+    for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j) {
+        if (i->first != j->first) return std::numeric_limits<double>::infinity();
+        for (const Point& p : i->second) worst = std::max(worst, to_boundary(p, j->second));
+        for (const Point& p : j->second) worst = std::max(worst, to_boundary(p, i->second));
+    }
+    return worst;
+}
+
+// Nearest live site to q by brute force, and its squared distance
+std::pair<int, double> nearest_live(const std::vector<Point>& sites, const std::vector<char>& live, const Point& q) {
+    std::pair<int, double> best{-1, 0.0};
+    for (std::size_t s = 0; s < sites.size(); ++s) {
+        const double d = dist2(sites[s], q);
+        if (live[s] && (best.first < 0 || d < best.second)) best = {static_cast<int>(s), d};
+    }
+    return best;
+}
+
+// Follows a compaction of the edited sites in the test's copy of them;
+// false unless exactly the removed ones were dropped, in order
+bool follow(const std::vector<int>& renumbering, std::vector<Point>& sites, std::vector<char>& live) {
+    if (renumbering.empty()) return true;
+    if (renumbering.size() != sites.size()) return false;
+    int n = 0;
+    for (std::size_t s = 0; s < sites.size(); ++s) {
+        if (renumbering[s] != (live[s] ? n : -1)) return false;
+        if (live[s]) sites[n++] = sites[s];
+    }
+    sites.resize(n);
+    live.assign(n, 1);
+    return true;
+}
+
+// Collinear sites removed one at a time: their cells are strips and, at
+// the ends, half-planes, with no vertex to splice at
+bool check_collinear_edits() {
+    std::vector<Point> sites;
+    for (int i = 0; i < 6; ++i) sites.push_back({double(i), 0.0});
+    std::vector<char> live(sites.size(), 1);
+    Voronoi::FortuneAlgorithm f;
+    f.set_build_diagram(true);
+    f.set_clip_rect(-50.0, -50.0, 50.0, 50.0);
+    f.add_points(sites);
+    f.compute();
+    for (const double x : {1.0, 4.0, 0.0, 3.0, 5.0}) {
+        for (std::size_t s = 0; s < sites.size(); ++s) {
+            if (live[s] && sites[s].x == x) {
+                f.remove_site(static_cast<int>(s));
+                live[s] = 0;
+            }
+        }
+        if (!follow(f.renumbering(), sites, live)) {
+            std::printf("  collinear edits: renumbered wrongly\n");
+            return false;
+        }
+        for (double qx = -1.0; qx <= 6.0; qx += 0.25) {
+            const Point q{qx, 1.0};
+            const int got = f.locate_cell(q);
+            if (got < 0 || !live[got] || dist2(sites[got], q) != nearest_live(sites, live, q).second) {
+                std::printf("  collinear edits: after removing x = %g, (%g, %g) located %d\n", x, q.x, q.y, got);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Sites given several times, with insert_site and remove_site taking the
+// copy that has the cell as often as the others. After every edit each
+// query must land on a live site as near as the nearest one, and the
+// nearest live site must come first in nearest_k; after every tenth the
+// cells must be those of a fresh sweep of the live sites. Compactions on
+// the way renumber the sites.
+bool check_edits(unsigned seeds) {
+    constexpr double tolerance = 1e-9 * 2000;
+    bool ok = check_collinear_edits();
+    for (unsigned seed = 0; seed < seeds; ++seed) {
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> u(0.0, 100.0);
+        std::vector<Point> sites = make_sites(duplicates, 60, seed);
+        std::vector<char> live(sites.size(), 1);
+        Voronoi::FortuneAlgorithm f;
+        f.set_build_diagram(true);
+        f.set_clip_rect(-500.0, -500.0, 1500.0, 1500.0);
+        f.add_points(sites);
+        f.compute();
+        Voronoi::FortuneAlgorithm fresh;
+        fresh.set_build_diagram(true);
+        fresh.set_clip_rect(-500.0, -500.0, 1500.0, 1500.0);
+        std::vector<Point> kept;
+        Voronoi::NeighborScratch scratch;
+        std::vector<int> near;
+        for (int edit = 0; edit < 200; ++edit) {
+            if (rng() % 2 == 0) {
+                // A copy of a live site, or a new one
+                const std::size_t t = rng() % sites.size();
+                const Point p = rng() % 4 == 0 || !live[t] ? Point{u(rng) * 10, u(rng) * 10} : sites[t];
+                bool known = false;
+                for (std::size_t s = 0; s < sites.size(); ++s) known |= live[s] && sites[s] == p;
+                const int s = f.insert_site(p);
+                if (!known) {
+                    sites.push_back(p);
+                    live.push_back(1);
+                }
+                if (!follow(f.renumbering(), sites, live) || s < 0 || s >= static_cast<int>(sites.size())
+                    || !live[s] || sites[s] != p) {
+                    std::printf("  edits seed %u edit %d: inserted as %d, or renumbered wrongly\n", seed, edit, s);
+                    ok = false;
+                    break;
+                }
+            } else {
+                // Every copy of a site in turn, cell owner or not
+                const std::size_t t = rng() % sites.size();
+                for (std::size_t s = 0; s < sites.size(); ++s) {
+                    if (live[s] && sites[s] == sites[t]) {
+                        f.remove_site(static_cast<int>(s));
+                        live[s] = 0;
+                        break;
+                    }
+                }
+                if (!follow(f.renumbering(), sites, live)) {
+                    std::printf("  edits seed %u edit %d: renumbered wrongly\n", seed, edit);
+                    ok = false;
+                    break;
+                }
+            }
+            if (std::find(live.begin(), live.end(), 1) == live.end()) break;
+            for (int k = 0; k < 20; ++k) {
+                const Point q{u(rng) * 10, u(rng) * 10};
+                const auto [want, d] = nearest_live(sites, live, q);
+                const int got = f.locate_cell(q);
+                f.nearest_k(q, 3, near, scratch);
+                if (got < 0 || !live[got] || dist2(sites[got], q) > d || near.empty() || !live[near[0]]
+                    || dist2(sites[near[0]], q) > d) {
+                    std::printf("  edits seed %u edit %d: query (%g, %g) located %d, nearest_k from %d, "
+                                "nearest live site %d\n",
+                                seed, edit, q.x, q.y, got, near.empty() ? -1 : near[0], want);
+                    ok = false;
+                    break;
+                }
+            }
+            if (!ok) break;
+
+            if (edit % 10 == 9) {
+                kept.clear();
+                for (std::size_t s = 0; s < sites.size(); ++s) {
+                    if (live[s]) kept.push_back(sites[s]);
+                }
+                fresh.reset();
+                fresh.add_points(kept);
+                fresh.compute();
+                Cells edited, swept;
+                for (std::size_t s = 0; s < sites.size(); ++s) {
+                    if (live[s]) add_cell(edited, sites[s], f.cell_polygon(static_cast<int>(s)), tolerance);
+                }
+                for (std::size_t s = 0; s < kept.size(); ++s) {
+                    add_cell(swept, kept[s], fresh.cell_polygon(static_cast<int>(s)), tolerance);
+                }
+                const double gap = cells_gap(edited, swept);
+                if (!(gap <= tolerance)) {
+                    std::printf("  edits seed %u edit %d: %zu cells after the edits, %zu swept afresh, off by %g\n",
+                                seed, edit, edited.size(), swept.size(), gap);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+// A compute after edits starts over whichever way it runs: compute_parallel
+// without the diagram, on sites of which some were removed, has to
+// locate over all of them and leave no diagram behind
+bool check_recompute(unsigned seeds) {
+    bool ok = true;
+    for (unsigned seed = 0; seed < seeds && ok; ++seed) {
+        const std::vector<Point> sites = make_sites(uniform, 8192, seed);
+        const std::vector<char> live(sites.size(), 1);
+        Voronoi::FortuneAlgorithm f;
+        f.set_build_diagram(true);
+        f.add_points(sites);
+        f.compute();
+        for (int s = 0; s < 1000; s += 3) f.remove_site(s);
+        f.set_build_diagram(false);
+        f.compute_parallel(4);
+
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> u(0.0, 1000.0);
+        for (int k = 0; k < 200 && ok; ++k) {
+            const Point q{u(rng), u(rng)};
+            const int got = f.locate_cell(q);
+            const double d = nearest_live(sites, live, q).second;
+            if (got < 0 || dist2(sites[got], q) != d || !f.get_diagram().half_edges.empty()) {
+                std::printf("  recompute seed %u: query (%g, %g) located %d, %zu half-edges left\n", seed, q.x, q.y,
+                            got, f.get_diagram().half_edges.size());
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// Bounding box of the sites as x0, y0, x1, y1, grown by 1 so that it has
+// an area
+template <typename T>
+std::array<double, 4> bounds(const std::vector<Voronoi::BasicPoint<T>>& sites) {
+    std::array<double, 4> box = {sites[0].x - 1.0, sites[0].y - 1.0, sites[0].x + 1.0, sites[0].y + 1.0};
+    for (const auto& p : sites) {
+        box = {std::min<double>(box[0], p.x - 1.0), std::min<double>(box[1], p.y - 1.0),
+               std::max<double>(box[2], p.x + 1.0), std::max<double>(box[3], p.y + 1.0)};
+    }
+    return box;
+}
+
+// locate_cell, locate_cells, nearest_k and within_radius against a scan
+// of all sites: every site found must have a cell, and the distances must
+// be those of the nearest distinct sites. Half the queries are random, the
+// other half sit on sites, where ties are common.
+template <typename T>
+bool check_neighbors(Input input, std::size_t n, unsigned seeds) {
+    bool ok = true;
+    for (unsigned seed = 0; seed < seeds && ok; ++seed) {
+        const std::vector<Voronoi::BasicPoint<T>> sites = as_type<T>(make_sites(input, n, seed));
+        std::vector<Point> at(sites.begin(), sites.end());
+        std::vector<Point> distinct = at;
+        std::sort(distinct.begin(), distinct.end(), [](const Point& a, const Point& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+        Voronoi::BasicFortuneAlgorithm<T> f;
+        f.set_build_diagram(true);
+        f.add_points(sites);
+        f.compute();
+        const auto box = bounds(sites);
+
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> ux(box[0], box[2]), uy(box[1], box[3]), u(0.0, 1.0);
+        std::vector<Point> queries;
+        for (int k = 0; k < 200; ++k) queries.push_back(k % 2 == 0 ? Point{ux(rng), uy(rng)} : at[rng() % n]);
+        std::vector<int> located(queries.size());
+        f.locate_cells(queries, located);
+
+        Voronoi::NeighborScratch scratch;
+        std::vector<int> near, within;
+        std::vector<double> want;
+        for (std::size_t i = 0; i < queries.size() && ok; ++i) {
+            const Point& q = queries[i];
+            want.clear();
+            for (const Point& p : distinct) want.push_back(dist2(q, p));
+            std::sort(want.begin(), want.end());
+            // About a dozen sites in range on uniform input
+            const double r = std::sqrt(want[std::min<std::size_t>(rng() % 12, want.size() - 1)]) * (0.5 + u(rng));
+            const std::size_t k = 1 + rng() % 8;
+            f.nearest_k(q, k, near, scratch);
+            f.within_radius(q, r, within, scratch);
+
+            // The distances of found, which must be those of want from the start
+            auto fits = [&](const std::vector<int>& found, std::size_t count) {
+                if (found.size() != count) return false;
+                for (std::size_t j = 0; j < found.size(); ++j) {
+                    const int s = found[j];
+                    if (s < 0 || s >= static_cast<int>(n) || f.get_diagram().faces[s].half_edge < 0) return false;
+                    if (dist2(q, at[s]) != want[j]) return false;
+                }
+                return true;
+            };
+            const std::size_t in_range = std::upper_bound(want.begin(), want.end(), r * r) - want.begin();
+            const int one = f.locate_cell(q);
+            const bool one_ok = one >= 0 && dist2(q, at[one]) == want[0];
+            const bool batch_ok = located[i] >= 0 && dist2(q, at[located[i]]) == want[0];
+            if (!one_ok || !batch_ok || !fits(near, std::min(k, want.size())) || !fits(within, in_range)) {
+                std::printf("  neighbours %s n %zu seed %u: query (%g, %g) located %d and %d, nearest %zu of %zu "
+                            "%s, %zu within %g of %zu %s\n",
+                            input_names[input], n, seed, q.x, q.y, one, located[i], near.size(), k,
+                            fits(near, std::min(k, want.size())) ? "ok" : "wrong", within.size(), r, in_range,
+                            fits(within, in_range) ? "ok" : "wrong");
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// Cells of BasicWindowedDiagram in random windows, from a tenth of the
+// box across to all of it, against the cells of the full diagram clipped
+// to the same window
+template <typename T>
+bool check_windows(Input input, std::size_t n, unsigned seeds) {
+    bool ok = true;
+    for (unsigned seed = 0; seed < seeds && ok; ++seed) {
+        const std::vector<Voronoi::BasicPoint<T>> sites = as_type<T>(make_sites(input, n, seed));
+        const auto box = bounds(sites);
+        const double scale = std::max({box[2] - box[0], box[3] - box[1], std::abs(box[0]), std::abs(box[1]),
+                                       std::abs(box[2]), std::abs(box[3])});
+        const double tolerance = (std::is_same_v<T, double> ? 1e-9 : 1e-6) * scale;
+        Voronoi::BasicFortuneAlgorithm<T> f;
+        f.set_build_diagram(true);
+        f.set_build_index(false);
+        f.add_points(sites);
+        f.compute();
+        Voronoi::BasicWindowedDiagram<T> windowed(sites, 2);
+        Voronoi::BasicWindowCells<T> cells;
+
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        for (int w = 0; w < 10 && ok; ++w) {
+            const double side = 0.1 + 0.9 * u(rng) * u(rng);
+            const double wx = (box[2] - box[0]) * side, wy = (box[3] - box[1]) * side;
+            const double x0 = box[0] + u(rng) * (box[2] - box[0] - wx), y0 = box[1] + u(rng) * (box[3] - box[1] - wy);
+            windowed.compute(x0, y0, x0 + wx, y0 + wy, cells);
+            f.set_clip_rect(x0, y0, x0 + wx, y0 + wy);
+
+            Cells got, want;
+            for (std::size_t i = 0; i < cells.size(); ++i) {
+                const std::span<const Point> c = cells.cell(i);
+                add_cell(got, Point(sites[cells.sites[i]]), std::vector<Point>(c.begin(), c.end()), tolerance);
+            }
+            for (std::size_t s = 0; s < n; ++s) add_cell(want, Point(sites[s]), f.cell_polygon(static_cast<int>(s)), tolerance);
+            const double gap = cells_gap(got, want);
+            if (!(gap <= tolerance)) {
+                std::printf("  windows %s n %zu seed %u: [%g, %g] x [%g, %g] has %zu cells, %zu clipped from the full "
+                            "diagram, off by %g\n",
+                            input_names[input], n, seed, x0, x0 + wx, y0, y0 + wy, got.size(), want.size(), gap);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t max_sites = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+    const unsigned seeds = argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 3;
+
+    // Enough threads for compute_parallel to split the larger inputs
+    Voronoi::CheckOptions options;
+    options.threads = 4;
+    options.repeats = 3;
+
+    std::vector<std::size_t> sizes = {1, 2, 3, 5, 10, 100, 1000};
+    sizes.erase(std::remove_if(sizes.begin(), sizes.end(), [&](std::size_t n) { return n >= max_sites; }), sizes.end());
+    sizes.push_back(max_sites);
+
+    std::printf("%-10s %6s %-6s %10s", "input", "sites", "type", "reference");
+    for (SweepMode m : modes) std::printf(" %16s", Voronoi::sweep_mode_name(m));
+    std::printf("\n");
+    bool all = true;
+    for (int input = uniform; input <= offset; ++input) {
+        for (std::size_t n : sizes) {
+            for (const char* type : {"double", "float", "int32"}) {
+                Row row;
+                // The largest inputs once: the reference is quadratic
+                const unsigned runs = n >= 1000 ? 1 : seeds;
+                const std::string name(type);
+                if (name == "double") run<double>(Input(input), n, runs, options, row);
+                if (name == "float") run<float>(Input(input), n, runs, options, row);
+                if (name == "int32") run<std::int32_t>(Input(input), n, runs, options, row);
+                std::printf("%-10s %6zu %-6s %8.2fms", input_names[input], n, type, row.reference_ms);
+                for (std::size_t m = 0; m < std::size(modes); ++m) {
+                    std::printf(" %8.3fms %-5s", row.sweep_ms[m], row.ok[m] ? "ok" : "FAIL");
+                    all = all && row.ok[m];
+                }
+                std::printf("\n");
+            }
+        }
+    }
+    // The queries and windows on every input at the largest size up to a
+    // thousand sites, whose cells the table above has checked
+    const std::size_t n = std::min<std::size_t>(max_sites, 1000);
+    for (const char* type : {"double", "float", "int32"}) {
+        bool near = true, windows = true;
+        const std::string name(type);
+        for (int input = uniform; input <= offset; ++input) {
+            if (name == "double") near = check_neighbors<double>(Input(input), n, seeds) && near;
+            if (name == "float") near = check_neighbors<float>(Input(input), n, seeds) && near;
+            if (name == "int32") near = check_neighbors<std::int32_t>(Input(input), n, seeds) && near;
+            if (name == "double") windows = check_windows<double>(Input(input), n, seeds) && windows;
+            if (name == "float") windows = check_windows<float>(Input(input), n, seeds) && windows;
+            if (name == "int32") windows = check_windows<std::int32_t>(Input(input), n, seeds) && windows;
+        }
+        std::printf("%-28s %s\n", ("neighbours " + name).c_str(), near ? "ok" : "FAIL");
+        std::printf("%-28s %s\n", ("windows " + name).c_str(), windows ? "ok" : "FAIL");
+        all = all && near && windows;
+    }
+    const bool edits = check_edits(seeds);
+    std::printf("%-28s %s\n", "edits", edits ? "ok" : "FAIL");
+    all = all && edits;
+    const bool recompute = check_recompute(seeds);
+    std::printf("%-28s %s\n", "compute after edits", recompute ? "ok" : "FAIL");
+    all = all && recompute;
+    std::printf(all ? "all match\n" : "MISMATCHES\n");
+    return all ? 0 : 1;
+}
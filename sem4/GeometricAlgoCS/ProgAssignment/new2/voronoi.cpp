@@ -1,290 +1,1009 @@
 #include "voronoi.hh"
+#include "predicates.hh"
 #include <algorithm>
-#include <memory>
+#include <cassert>
+#include <charconv>
 #include <cmath>
+#include <cstring>
+#include <numeric>
 
 namespace Voronoi {
 
-void FortuneAlgorithm::add_point(const Point& p) {
-    points.push(p);
+namespace {
+
+// Maps a double to an unsigned key with the same ordering
+std::uint64_t sort_key(double v) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, sizeof bits);
+    return (bits >> 63) ? ~bits : bits | (std::uint64_t(1) << 63);
+}
+
+constexpr int digit_bits = 11;
+constexpr int passes = (64 + digit_bits - 1) / digit_bits;
+constexpr std::size_t buckets = std::size_t(1) << digit_bits;
+// Below this many sites clearing the counts costs more than a plain sort,
+// as for the few sites around an edit
+constexpr std::size_t radix_min = 256;
+
+// LSD radix sort of site indices on key(s), 11 bits per pass. Passes where
+// all keys share the digit are skipped, which drops most of them for sites
+// spread over a bounded range. The buffers are the caller's, so repeated
+// sorts reuse them.
+template <typename Key>
+void radix_sort(std::vector<std::uint32_t>& order, Key key,
+                std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& keys_tmp,
+                std::vector<std::uint32_t>& order_tmp, std::vector<std::size_t>& count) {
+    const std::size_t n = order.size();
     
-    // Update bounding box
-    if (points.size() == 1) {
-        x_min = x_max = p.x;
-        y_min = y_max = p.y;
-    } else {
-        x_min = std::min(x_min, p.x);
-        y_min = std::min(y_min, p.y);
-        x_max = std::max(x_max, p.x);
-        y_max = std::max(y_max, p.y);
+    keys.resize(n);
+    keys_tmp.resize(n);
+    order_tmp.resize(n);
+    count.assign(passes * buckets, 0);
+    
+    for (std::size_t i = 0; i < n; ++i) {
+        keys[i] = sort_key(key(order[i]));
+        for (int pass = 0; pass < passes; ++pass) {
+            ++count[pass * buckets + ((keys[i] >> (pass * digit_bits)) & (buckets - 1))];
+        }
+    }
+    
+    for (int pass = 0; pass < passes; ++pass) {
+        std::size_t* c = &count[pass * buckets];
+        const int shift = pass * digit_bits;
+        if (c[(keys[0] >> shift) & (buckets - 1)] == n) continue;
+        
+        std::size_t sum = 0;
+        for (std::size_t d = 0; d < buckets; ++d) {
+            const std::size_t k = c[d];
+            c[d] = sum;
+            sum += k;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::size_t dst = c[(keys[i] >> shift) & (buckets - 1)]++;
+            keys_tmp[dst] = keys[i];
+            order_tmp[dst] = order[i];
+        }
+        keys.swap(keys_tmp);
+        order.swap(order_tmp);
     }
 }
 
-void FortuneAlgorithm::compute() {
-    // Add margins to the bounding box
-    const double dx = (x_max - x_min + 1) / 5.0;
-    const double dy = (y_max - y_min + 1) / 5.0;
-    x_min -= dx; x_max += dx;
-    y_min -= dy; y_max += dy;
+// Appends v the way std::ostream prints it by default (%g, 6 digits)
+void append_number(std::string& out, double v) {
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof buf, v, std::chars_format::general, 6);
+    out.append(buf, res.ptr);
+}
+
+} // namespace
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::add_point(const Site& p) {
+    sites.push_back(p);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::add_points(std::span<const Site> ps) {
+    sites.insert(sites.end(), ps.begin(), ps.end());
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::add_point(const Site& p, double w) requires Geometry::weighted {
+    add_point(p);
+    geometry.weights.push_back(w);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::add_points(std::span<const Site> ps, std::span<const double> ws)
+    requires Geometry::weighted {
+    assert(ps.size() == ws.size());
+    add_points(ps);
+    geometry.weights.insert(geometry.weights.end(), ws.begin(), ws.end());
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::reset() {
+    sites.clear();
+    if constexpr (Geometry::weighted) geometry.weights.clear();
+    order.clear();
+    sweep_sites = {};
+    next_site = 0;
+    clear_results();
+    site_index.clear();
+    x_min = x_max = y_min = y_max = 0.0;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::reserve(std::size_t n) {
+    sites.reserve(n);
+    if constexpr (Geometry::weighted) geometry.weights.reserve(n);
+    order.reserve(n);
+    sort_keys.reserve(n);
+    sort_keys_tmp.reserve(n);
+    order_tmp.reserve(n);
+    sort_counts.reserve(passes * buckets);
+    // The sweep splits most edges where a site arrived
+    if (!edge_sink) output_segments.reserve(4 * n);
+    if (build_diagram) {
+        diagram.vertices.reserve(2 * n);
+        diagram.half_edges.reserve(6 * n);
+        diagram.faces.reserve(n);
+    }
+    if (build_triangulation) {
+        triangulation.triangles.reserve(2 * n);
+        edge_triangles.reserve(3 * n);
+    }
+    if (build_index) site_index.reserve(n);
+    
+    // The beach line of spread-out sites holds a few sqrt(n) arcs; anything
+    // beyond that is allocated by the first run and kept
+    const std::size_t front = 4 * static_cast<std::size_t>(std::sqrt(double(n))) + 64;
+    beach.reserve(front);
+    event_pool.reserve(front);
+    events.reserve(front);
+    open_starts.reserve(front);
+    free_segments.reserve(front);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::compute() {
+    frame(sites);
+    clear_results();
+    if constexpr (Geometry::weighted) geometry.weights.resize(sites.size(), 0.0);
+    
+    sweep_sites = sites;
+    sort_sites();
+    if (build_diagram) diagram.faces.assign(sites.size(), {-1});
+    
+    sweep();
+    if (build_diagram) finish_diagram();
+    
+    if (build_index) site_index.build<T>(sites);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::compute_stream(std::span<const Site> sorted) requires (!Geometry::weighted) {
+    assert(edge_sink && !build_diagram && !build_triangulation);
+    if (sorted.empty()) {
+        clear_results();
+        return;
+    }
+    
+    frame(sorted);
+    begin_stream(sorted);
+    sweep();
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::begin_stream(std::span<const Site> sorted) {
+    clear_results();
     
-    // Process the queues
-    while (!points.empty()) {
-        if (!events.empty() && events.top()->x <= points.top().x) {
+    // The stream is its own sweep order
+    order.clear();
+    order.shrink_to_fit();
+    next_site = 0;
+    sweep_sites = sorted;
+    site_index = SiteIndex();
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::clear_results() {
+    output_segments.clear();
+    diagram.clear();
+    free_vertices.clear();
+    free_edges.clear();
+    triangulation.clear();
+    duplicates.clear();
+    removed.clear();
+    moved_to.clear();
+    edits_since_index = 0;
+    renumbered.clear();
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::sweep() {
+    VORONOI_STAT(sweep_stats = SweepStats());
+    sweep_until(sweep_sites.size());
+    finish_sweep();
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::sweep_until(std::size_t end) {
+    // Merge the sorted sites with the event queue
+    while (next_site < end) {
+        if (!events.empty() && events.top()->x <= key(sweep_index(next_site))) {
             process_event();
         } else {
             process_point();
         }
     }
-    
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::finish_sweep() {
     // Process remaining circle events
     while (!events.empty()) {
         process_event();
     }
     
     finish_edges();
+    open_starts.clear();
+    free_segments.clear();
+    edge_triangles.clear();
+    
+    // The sweep structures are dead now, so their storage goes in one shot
+    beach.clear();
+    event_pool.clear();
+}
+
+template <typename T, typename Geometry>
+std::vector<BasicSegment<T>> BasicFortuneAlgorithm<T, Geometry>::get_segments() const {
+    return output_segments;
 }
 
-std::vector<SegmentPtr> FortuneAlgorithm::get_segments() const {
+template <typename T, typename Geometry>
+std::span<const BasicSegment<T>> BasicFortuneAlgorithm<T, Geometry>::segments() const {
     return output_segments;
 }
 
-int FortuneAlgorithm::locate_cell(const Point& q) const {
-    // Find the closest point in the diagram to q
-    int closest_index = -1;
-    double min_distance = std::numeric_limits<double>::max();
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::locate_cell(const Point& q) const requires (!Geometry::weighted) {
+    return cells().locate(q);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::locate_cells(std::span<const Point> queries, std::span<int> out) const
+    requires (!Geometry::weighted) {
+    cells().locate(queries, out);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::nearest_k(const Point& q, std::size_t k, std::vector<int>& out,
+                                                   NeighborScratch& scratch) const requires (!Geometry::weighted) {
+    assert(build_diagram);
+    cells().nearest_k(q, k, out, scratch);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::within_radius(const Point& q, double r, std::vector<int>& out,
+                                                       NeighborScratch& scratch) const requires (!Geometry::weighted) {
+    assert(build_diagram);
+    cells().within_radius(q, r, out, scratch);
+}
+
+template <typename T, typename Geometry>
+std::unique_ptr<const BasicSnapshot<T>> BasicFortuneAlgorithm<T, Geometry>::snapshot() const
+    requires (!Geometry::weighted) {
+    auto s = std::make_unique<BasicSnapshot<T>>();
+    s->sites = sites;
+    s->diagram = diagram;
+    s->index = site_index;
+    s->duplicates = duplicates;
+    s->removed = removed;
+    s->moved_to = moved_to;
+    return s;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::print_output() const {
+    // Lines are formatted into a buffer and written out in large blocks
+    std::string out;
+    auto line = [&out](double a, double b, double c, double d) {
+        append_number(out, a);
+        out += ' ';
+        append_number(out, b);
+        out += ' ';
+        append_number(out, c);
+        out += ' ';
+        append_number(out, d);
+        out += '\n';
+    };
     
-    // This is a naive O(n) implementation - for better performance, 
-    // you'd want to use a spatial index or walk the diagram structure
+    // Bounding box coordinates
+    line(x_min, x_max, y_min, y_max);
     
-    // First, collect all the sites
-    std::vector<Point> sites;
-    for (ArcPtr arc = root; arc != nullptr; arc = arc->next) {
-        sites.push_back(arc->p);
+    // Output each segment
+    for (const auto& seg : output_segments) {
+        if (!seg.done) continue;
+        line(seg.start.x, seg.start.y, seg.end.x, seg.end.y);
+        if (out.size() >= (1 << 16)) {
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
     }
+    std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+template <typename T, typename Geometry>
+std::vector<Point> BasicFortuneAlgorithm<T, Geometry>::cell_polygon(int s) const requires (!Geometry::weighted) {
+    assert(build_diagram);
+    std::vector<Point> poly = clip.points();
+    if (poly.empty()) poly = {{x_min, y_min}, {x_max, y_min}, {x_max, y_max}, {x_min, y_max}};
     
-    // Find the closest site
-    for (size_t i = 0; i < sites.size(); ++i) {
-        double dist = std::hypot(q.x - sites[i].x, q.y - sites[i].y);
-        if (dist < min_distance) {
-            min_distance = dist;
-            closest_index = static_cast<int>(i);
+    const int first = diagram.faces[s].half_edge;
+    if (first < 0) {
+        // Only a lone site owns everything
+        if (sites.size() != 1) poly.clear();
+        return poly;
+    }
+    if (diagram.vertices.empty()) {
+        // Collinear sites: a cell in the middle is a strip between two
+        // edges that share no vertex, so its boundary is not one chain
+        for (std::size_t t = 0; t < sites.size(); ++t) {
+            const bool live = removed.empty() || !removed[t];
+            if (live && sites[t] != sites[s]) ClipPolygon::cut(poly, sites[s], sites[t]);
         }
+        return poly;
+    }
+    // The cell is the region closer to s than to any of its neighbours
+    for (int h = first; h >= 0;) {
+        ClipPolygon::cut(poly, sites[s], sites[diagram.neighbor(h)]);
+        h = diagram.half_edges[h].next;
+        if (h == first) break;
+    }
+    return poly;
+}
+
+// Bounding box of ps with margins, for the far ends of open edges
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::frame(std::span<const Site> ps) {
+    double x0 = 0.0, x1 = 0.0, y0 = 0.0, y1 = 0.0;
+    if (!ps.empty()) {
+        x0 = x1 = ps[0].x;
+        y0 = y1 = ps[0].y;
     }
+    for (const Site& p : ps) {
+        x0 = std::min<double>(x0, p.x);
+        y0 = std::min<double>(y0, p.y);
+        x1 = std::max<double>(x1, p.x);
+        y1 = std::max<double>(y1, p.y);
+    }
+    frame(x0, y0, x1, y1);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::frame(double x0, double y0, double x1, double y1) {
+    x_min = x0;
+    y_min = y0;
+    x_max = x1;
+    y_max = y1;
     
-    return closest_index;
+    // Add margins to the bounding box
+    const double dx = (x_max - x_min + 1) / 5.0;
+    const double dy = (y_max - y_min + 1) / 5.0;
+    x_min -= dx; x_max += dx;
+    y_min -= dy; y_max += dy;
+    cover_clip();
 }
 
-void FortuneAlgorithm::print_output() const {
-    // Bounding box coordinates
-    std::cout << x_min << " " << x_max << " " << y_min << " " << y_max << "\n";
+// Far ends of open edges have to lie beyond the clip region too
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::cover_clip() {
+    for (const Point& c : clip.points()) {
+        x_min = std::min(x_min, c.x);
+        y_min = std::min(y_min, c.y);
+        x_max = std::max(x_max, c.x);
+        y_max = std::max(y_max, c.y);
+    }
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::sort_sites() {
+    next_site = 0;
+    if (order.size() == sites.size() && repair_order()) return;
     
-    // Output each segment
-    for (const auto& seg : output_segments) {
-        if (seg->done) {
-            std::cout << seg->start.x << " " << seg->start.y << " "
-                      << seg->end.x << " " << seg->end.y << "\n";
+    order.resize(sites.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto before = [this](std::uint32_t i, std::uint32_t j) { return sweeps_before(i, j); };
+    if (std::is_sorted(order.begin(), order.end(), before)) return;
+    if (order.size() < radix_min) {
+        std::sort(order.begin(), order.end(), before);
+        return;
+    }
+    
+    radix_sort(order, [this](std::uint32_t s) { return key(s); }, sort_keys, sort_keys_tmp, order_tmp, sort_counts);
+    
+    // Put runs of equal keys in y order
+    for (std::size_t b = 0; b < order.size();) {
+        std::size_t e = b + 1;
+        while (e < order.size() && key(order[e]) == key(order[b])) ++e;
+        if (e - b > 1) {
+            std::sort(order.begin() + b, order.begin() + e,
+                      [this](std::uint32_t i, std::uint32_t j) { return sites[i].y < sites[j].y; });
+        }
+        b = e;
+    }
+}
+
+// The order of the last run is still a permutation of the sites when their
+// number has not changed. Sites that have only moved a little since then
+// (relax()) are put back in order by insertion sort, which gives up after a
+// few moves per site and leaves the rest to the radix sort.
+template <typename T, typename Geometry>
+bool BasicFortuneAlgorithm<T, Geometry>::repair_order() {
+    std::size_t budget = 4 * order.size();
+    for (std::size_t k = 1; k < order.size(); ++k) {
+        const std::uint32_t s = order[k];
+        std::size_t j = k;
+        while (j > 0 && budget > 0 && sweeps_before(s, order[j - 1])) {
+            order[j] = order[j - 1];
+            --j;
+            --budget;
         }
+        order[j] = s;
+        if (budget == 0) return false;
     }
+    return true;
 }
 
-void FortuneAlgorithm::process_point() {
-    Point p = points.top();
-    points.pop();
-    front_insert(p);
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::process_point() {
+    VORONOI_PHASE(process_point_time);
+    const Site& p = sweep_sites[sweep_index(next_site)];
+    
+    // Duplicates are adjacent once sorted; only the first one is inserted
+    if (next_site == 0 || p != sweep_sites[sweep_index(next_site - 1)]) {
+        front_insert(sweep_index(next_site));
+        VORONOI_STAT(++sweep_stats.sites);
+        VORONOI_STAT(sweep_stats.max_beach_length = std::max<std::uint64_t>(sweep_stats.max_beach_length, beach.size()));
+    }
+    ++next_site;
 }
 
-void FortuneAlgorithm::process_event() {
-    EventPtr e = events.top();
-    events.pop();
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::process_event() {
+    VORONOI_PHASE(process_event_time);
+    VORONOI_STAT(++sweep_stats.circle_events_executed);
+    Event* e = events.pop();
     
-    if (e->valid) {
-        // Create a new segment
-        auto s = std::make_shared<Segment>(e->p);
-        output_segments.push_back(s);
-        
-        // Remove the associated arc
-        ArcPtr a = e->arc;
-        if (a->prev) {
-            a->prev->next = a->next;
-            a->prev->right_segment = s;
-        }
-        if (a->next) {
-            a->next->prev = a->prev;
-            a->next->left_segment = s;
-        }
+    // Create a new segment
+    int s = new_segment(e->p);
+    
+    // Remove the associated arc
+    const ArcId a = e->arc;
+    beach.erase(a);
+    const ArcId lo = beach.prev(a);
+    const ArcId hi = beach.next(a);
+    const ArcCold dead = beach.cold(a);
+    if (lo) beach.cold(lo).right_segment = s;
+    if (hi) beach.cold(hi).left_segment = s;
+    
+    // Finish the edges
+    if (dead.left_segment >= 0) finish_segment(dead.left_segment, e->p);
+    if (dead.right_segment >= 0) finish_segment(dead.right_segment, e->p);
+    
+    if ((build_diagram || build_triangulation) && lo && hi) {
+        // a's cell closes at the new vertex: the edges on either side of it
+        // end there and one between its neighbours starts
+        const int lo_site = beach.cold(lo).site;
+        const int hi_site = beach.cold(hi).site;
+        const int ac = sweep_edge(lo_site, hi_site);
+        beach.cold(lo).right_edge = beach.cold(hi).left_edge = ac;
         
-        // Finish the edges
-        if (a->left_segment) a->left_segment->finish(e->p);
-        if (a->right_segment) a->right_segment->finish(e->p);
+        // circle() only fires for clockwise lo, a, hi
+        if (build_triangulation) add_triangle(lo_site, hi_site, dead.site, dead.right_edge, dead.left_edge, ac);
         
-        // Recheck circle events
-        if (a->prev) check_circle_event(a->prev, e->x);
-        if (a->next) check_circle_event(a->next, e->x);
+        if (build_diagram) {
+            const int v = new_vertex(e->p, half_edge(dead.left_edge, lo_site));
+            diagram.half_edges[half_edge(dead.left_edge, lo_site)].origin = v;
+            diagram.half_edges[half_edge(dead.right_edge, dead.site)].origin = v;
+            diagram.half_edges[half_edge(ac, hi_site)].origin = v;
+            
+            link(half_edge(ac, lo_site), half_edge(dead.left_edge, lo_site));
+            link(half_edge(dead.left_edge, dead.site), half_edge(dead.right_edge, dead.site));
+            link(half_edge(dead.right_edge, hi_site), half_edge(ac, hi_site));
+        }
     }
+    
+    // Recheck circle events
+    if (lo) check_circle_event(lo, e->x);
+    if (hi) check_circle_event(hi, e->x);
+    
+    beach.destroy(a);
+    event_pool.destroy(e);
 }
 
-void FortuneAlgorithm::front_insert(const Point& p) {
-    if (!root) {
-        root = std::make_shared<Arc>(p);
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::front_insert(std::uint32_t s) {
+    const Point p = sweep_sites[s];
+    const int site = static_cast<int>(s);
+    const double l = key(s);
+    if (beach.empty()) {
+        beach.insert_after(0, beach.create(p, site));
         return;
     }
     
-    // Find the current arc(s) at height p.y
-    for (ArcPtr i = root; i != nullptr; i = i->next) {
-        Point z, zz;
-        if (intersect(p, i, &z)) {
-            // New parabola intersects arc i
-            if (i->next && !intersect(p, i->next, &zz)) {
-                i->next->prev = std::make_shared<Arc>(i->p, i, i->next);
-                i->next = i->next->prev;
-            } else {
-                i->next = std::make_shared<Arc>(i->p, i);
-            }
-            i->next->right_segment = i->right_segment;
-            
-            // Add p between i and i->next
-            i->next->prev = std::make_shared<Arc>(p, i, i->next);
-            i->next = i->next->prev;
-            
-            i = i->next; // Now i points to the new arc
-            
-            // Add new segments
-            i->prev->right_segment = i->left_segment = std::make_shared<Segment>(z);
-            output_segments.push_back(i->left_segment);
-            
-            i->next->left_segment = i->right_segment = std::make_shared<Segment>(z);
-            output_segments.push_back(i->right_segment);
+    // Descend to the arc above p.y, comparing against the breakpoints
+    // on either side of each node at the current sweep position l
+    ArcId i = beach.root;
+    double a = 0.0, b = 0.0;
+    VORONOI_STAT(std::uint64_t visited = 0);
+    for (;;) {
+        VORONOI_STAT(++visited);
+        const ArcHot& h = beach.hot(i);
+        if (h.prev) a = breakpoint(h.prev, i, l);
+        if (h.next) b = breakpoint(i, h.next, l);
+        
+        if (h.prev && p.y < a && h.left) {
+            i = h.left;
+        } else if (h.next && p.y > b && h.right) {
+            i = h.right;
+        } else {
+            break;
+        }
+    }
+    VORONOI_STAT(sweep_stats.arcs_visited += visited);
+    VORONOI_STAT(sweep_stats.max_arcs_visited = std::max(sweep_stats.max_arcs_visited, visited));
+    
+    const Point ip = beach.hot(i).p;
+    const int i_site = beach.cold(i).site;
+    if (ip == p) return; // Duplicate site
+    
+    if (geometry.key(ip, i_site) == l) {
+        // Special case: sites sharing the first sweep position have no
+        // parabola yet, so p is appended after the arc it lands on
+        const ArcId j = beach.create(p, site);
+        beach.insert_after(i, j);
+        
+        // Insert segment between p and i. It comes in from the far left and
+        // gets its start once its end is known.
+        Point start;
+        start.x = -INFINITY;
+        start.y = (p.y + ip.y) / 2;
+        beach.cold(i).right_segment = beach.cold(j).left_segment = new_segment(start);
+        if (build_diagram || build_triangulation) {
+            beach.cold(i).right_edge = beach.cold(j).left_edge = sweep_edge(i_site, site);
+        }
+        return;
+    }
+    
+    // Plug back into parabola equation
+    Point z;
+    z.y = p.y;
+    z.x = geometry.arc_x(ip, i_site, z.y, l);
+    
+    // A weighted site enters as the ray back from p, which only shows if
+    // the beach line is behind p; otherwise its circle is inside another
+    if constexpr (Geometry::weighted) {
+        if (z.x >= p.x) return;
+    }
+    
+    if ((beach.prev(i) && p.y == a) || (beach.next(i) && p.y == b)) {
+        // p lands exactly on a breakpoint: z is a vertex, so p goes
+        // between the two arcs without splitting either of them
+        if (beach.prev(i) && p.y == a) i = beach.prev(i);
+        const ArcId j = beach.create(p, site);
+        beach.insert_after(i, j);
+        const ArcId k = beach.next(j);
+        
+        if (beach.cold(i).right_segment >= 0) finish_segment(beach.cold(i).right_segment, z);
+        
+        beach.cold(i).right_segment = beach.cold(j).left_segment = new_segment(z);
+        beach.cold(j).right_segment = beach.cold(k).left_segment = new_segment(z);
+        
+        if (build_diagram || build_triangulation) {
+            // The edge between i and its old neighbour k ends at z, and
+            // the two edges around the new cell start there
+            const int lo_site = beach.cold(i).site;
+            const int hi_site = beach.cold(k).site;
+            const int ik = beach.cold(i).right_edge;
+            const int ij = sweep_edge(lo_site, site);
+            const int jk = sweep_edge(site, hi_site);
+            beach.cold(i).right_edge = beach.cold(j).left_edge = ij;
+            beach.cold(j).right_edge = beach.cold(k).left_edge = jk;
             
-            // Check for new circle events
-            check_circle_event(i, p.x);
-            check_circle_event(i->prev, p.x);
-            check_circle_event(i->next, p.x);
+            // p is on the circle through i and k, level with its centre z
+            // and ahead of it, which makes k, i, p counterclockwise
+            if (build_triangulation) add_triangle(hi_site, lo_site, site, ij, jk, ik);
             
-            return;
+            if (build_diagram) {
+                const int v = new_vertex(z, half_edge(ij, site));
+                diagram.half_edges[half_edge(ik, lo_site)].origin = v;
+                diagram.half_edges[half_edge(ij, site)].origin = v;
+                diagram.half_edges[half_edge(jk, hi_site)].origin = v;
+                
+                link(half_edge(ij, lo_site), half_edge(ik, lo_site));
+                link(half_edge(ik, hi_site), half_edge(jk, hi_site));
+                link(half_edge(jk, site), half_edge(ij, site));
+            }
         }
+        
+        check_circle_event(i, l);
+        check_circle_event(k, l);
+        return;
     }
     
-    // Special case: if p never intersects an arc, append to the list
-    ArcPtr i;
-    for (i = root; i->next != nullptr; i = i->next) {}
+    // New parabola splits arc i into i, p, copy of i
+    const ArcId j = beach.create(ip, i_site);
+    beach.insert_after(i, j);
+    beach.cold(j).right_segment = beach.cold(i).right_segment;
+    beach.cold(j).right_edge = beach.cold(i).right_edge;
     
-    i->next = std::make_shared<Arc>(p, i);
-    // Insert segment between p and i
-    Point start;
-    start.x = x_min;
-    start.y = (i->next->p.y + i->p.y) / 2;
-    i->right_segment = i->next->left_segment = std::make_shared<Segment>(start);
-    output_segments.push_back(i->right_segment);
+    const ArcId n = beach.create(p, site);
+    beach.insert_after(i, n);
+    
+    // Add new segments
+    beach.cold(i).right_segment = beach.cold(n).left_segment = new_segment(z);
+    beach.cold(j).left_segment = beach.cold(n).right_segment = new_segment(z);
+    
+    // z is not a vertex: both segments are halves of a single diagram edge
+    if (build_diagram || build_triangulation) {
+        const int e = sweep_edge(i_site, site);
+        beach.cold(i).right_edge = beach.cold(n).left_edge = beach.cold(n).right_edge = beach.cold(j).left_edge = e;
+    }
+    
+    // Check for new circle events
+    check_circle_event(n, l);
+    check_circle_event(i, l);
+    check_circle_event(j, l);
+}
+
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::new_segment(const Point& start) {
+    if (!free_segments.empty()) {
+        const int s = free_segments.back();
+        free_segments.pop_back();
+        open_starts[s] = start;
+        return s;
+    }
+    open_starts.push_back(start);
+    return static_cast<int>(open_starts.size()) - 1;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::finish_segment(int s, const Point& p) {
+    // Nothing refers to a finished segment any more, so its slot is
+    // reused right away
+    Point start = open_starts[s];
+    Point end = p;
+    free_segments.push_back(s);
+    if (start.x == -INFINITY) {
+        const Point m(sweep_sites[sweep_index(0)].x, start.y);
+        start = ray_end(m, m, end, {-1.0, 0.0});
+    }
+    
+    // Ends are cut in double and only then stored as T
+    if (!clip.empty() && !clip.clip(start, end)) return;
+    Segment seg{Site(start)};
+    seg.finish(Site(end));
+    if (edge_sink) {
+        edge_sink(seg);
+    } else {
+        output_segments.push_back(seg);
+    }
+}
+
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::sweep_edge(int a, int b) {
+    // Nothing is freed during a sweep, so the diagram hands out the same
+    // indices as the table of pending triangles
+    if (build_triangulation) edge_triangles.push_back(-1);
+    if (build_diagram) return new_edge(a, b);
+    return static_cast<int>(edge_triangles.size()) - 1;
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::add_triangle(int a, int b, int c, int bc, int ca, int ab) {
+    const int t = static_cast<int>(triangulation.triangles.size());
+    triangulation.triangles.push_back({{a, b, c}, {-1, -1, -1}});
+    
+    // The first triangle on an edge waits there for the second one
+    const int opposite[3] = {bc, ca, ab};
+    for (int corner = 0; corner < 3; ++corner) {
+        int& pending = edge_triangles[opposite[corner]];
+        if (pending < 0) {
+            pending = 3 * t + corner;
+        } else {
+            triangulation.triangles[pending / 3].adj[pending % 3] = t;
+            triangulation.triangles[t].adj[corner] = pending / 3;
+        }
+    }
+}
+
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::new_edge(int a, int b) {
+    if (!free_edges.empty()) {
+        const int edge = free_edges.back();
+        free_edges.pop_back();
+        diagram.half_edges[2 * edge] = {-1, -1, -1, a};
+        diagram.half_edges[2 * edge + 1] = {-1, -1, -1, b};
+        return edge;
+    }
+    diagram.half_edges.push_back({-1, -1, -1, a});
+    diagram.half_edges.push_back({-1, -1, -1, b});
+    return static_cast<int>(diagram.half_edges.size() / 2) - 1;
+}
+
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::new_vertex(const Point& p, int leaving) {
+    if (!free_vertices.empty()) {
+        const int v = free_vertices.back();
+        free_vertices.pop_back();
+        diagram.vertices[v] = {p, leaving};
+        return v;
+    }
+    diagram.vertices.push_back({p, leaving});
+    return static_cast<int>(diagram.vertices.size()) - 1;
+}
+
+// The half of the edge that lies in the given face
+template <typename T, typename Geometry>
+int BasicFortuneAlgorithm<T, Geometry>::half_edge(int edge, int face) const {
+    return 2 * edge + (diagram.half_edges[2 * edge].face != face);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::link(int h, int next) {
+    diagram.half_edges[h].next = next;
+    diagram.half_edges[next].prev = h;
 }
 
-bool FortuneAlgorithm::check_circle_event(ArcPtr i, double x0) {
-    // Invalidate any old event
-    if (i->event && i->event->x != x0) {
-        i->event->valid = false;
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::finish_diagram() {
+    // Point every face at a half-edge, preferring the start of an open chain
+    for (int h = 0; h < static_cast<int>(diagram.half_edges.size()); ++h) {
+        const Diagram::HalfEdge& he = diagram.half_edges[h];
+        int& first = diagram.faces[he.face].half_edge;
+        if (first < 0 || (he.prev < 0 && diagram.half_edges[first].prev >= 0)) first = h;
     }
-    i->event = nullptr;
+    find_duplicates();
+}
+
+// Equal sites are next to each other in sweep order, and one of them has
+// the cell
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::find_duplicates() {
+    duplicates.clear();
+    for (std::size_t i = 0; i < order.size();) {
+        std::size_t j = i + 1;
+        while (j < order.size() && sites[order[j]] == sites[order[i]]) ++j;
+        if (j - i > 1) {
+            int owner = -1;
+            for (std::size_t k = i; k < j; ++k) {
+                if (diagram.faces[order[k]].half_edge >= 0) owner = static_cast<int>(order[k]);
+            }
+            for (std::size_t k = i; owner >= 0 && k < j; ++k) {
+                if (static_cast<int>(order[k]) != owner) duplicates.push_back({static_cast<int>(order[k]), owner});
+            }
+        }
+        i = j;
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+}
+
+template <typename T, typename Geometry>
+bool BasicFortuneAlgorithm<T, Geometry>::check_circle_event(ArcId i, double x0) {
+    // Drop any old event
+    if (Event* old = beach.cold(i).event) {
+        VORONOI_STAT(++sweep_stats.circle_events_invalidated);
+        events.remove(old);
+        event_pool.destroy(old);
+    }
+    beach.cold(i).event = nullptr;
     
-    if (!i->prev || !i->next) {
+    const ArcId lo = beach.prev(i);
+    const ArcId hi = beach.next(i);
+    if (!lo || !hi) {
         return false;
     }
     
     double x;
     Point o;
     
-    if (circle(i->prev->p, i->p, i->next->p, &x, &o) && x > x0) {
-        i->event = std::make_shared<Event>(x, o, i);
-        events.push(i->event);
+    // Converging breakpoints meet at or after the current sweep position;
+    // an event computed a little before it is due right now. Vertices of
+    // cocircular groups and sites that land on a vertex come out that way.
+    if (geometry.template circle<T>(beach.hot(lo).p, beach.cold(lo).site, beach.hot(i).p, beach.cold(i).site,
+                                    beach.hot(hi).p, beach.cold(hi).site, &x, &o)) {
+        Event* e = event_pool.create(std::max(x, x0), o, i);
+        beach.cold(i).event = e;
+        events.push(e);
+        VORONOI_STAT(++sweep_stats.circle_events_created);
+        VORONOI_STAT(sweep_stats.max_heap_size = std::max<std::uint64_t>(sweep_stats.max_heap_size, events.size()));
         return true;
     }
     
     return false;
 }
 
-bool FortuneAlgorithm::circle(const Point& a, const Point& b, const Point& c, double* x, Point* o) const {
-    // Check that bc is a "right turn" from ab
-    if ((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y) > 0) {
-        return false;
+template <typename T, typename Geometry>
+double BasicFortuneAlgorithm<T, Geometry>::breakpoint(ArcId lo, ArcId hi, double l) const {
+    VORONOI_STAT(++sweep_stats.intersections);
+    return geometry.breakpoint(beach.hot(lo).p, beach.cold(lo).site, beach.hot(hi).p, beach.cold(hi).site, l);
+}
+
+template <typename T, typename Geometry>
+void BasicFortuneAlgorithm<T, Geometry>::finish_edges() {
+    VORONOI_PHASE(finish_edges_time);
+    // Every remaining breakpoint runs off to infinity, lower arc on its right
+    for (ArcId i = beach.front(); i && beach.next(i); i = beach.next(i)) {
+        const int s = beach.cold(i).right_segment;
+        if (s >= 0) {
+            const ArcId k = beach.next(i);
+            const Point& a = beach.hot(i).p;
+            const Point& b = beach.hot(k).p;
+            const Point dir = geometry.asymptote(a, beach.cold(i).site, b, beach.cold(k).site);
+            const Point end = ray_end(a, b, open_starts[s], dir);
+            finish_segment(s, end);
+        }
     }
-    
-    // Algorithm from O'Rourke 2ed p. 189
-    const double A = b.x - a.x;
-    const double B = b.y - a.y;
-    const double C = c.x - a.x;
-    const double D = c.y - a.y;
-    const double E = A * (a.x + b.x) + B * (a.y + b.y);
-    const double F = C * (a.x + c.x) + D * (a.y + c.y);
-    const double G = 2 * (A * (c.y - b.y) - B * (c.x - b.x));
-    
-    if (G == 0) return false; // Points are colinear
-    
-    // Point o is the center of the circle
-    o->x = (D * E - B * F) / G;
-    o->y = (A * F - C * E) / G;
-    
-    // o.x plus radius equals max x coordinate
-    *x = o->x + std::hypot(a.x - o->x, a.y - o->y);
-    return true;
 }
 
-bool FortuneAlgorithm::intersect(const Point& p, ArcPtr i, Point* res) const {
-    if (i->p.x == p.x) return false;
+// Cut-off point of the ray along dir on the bisector (or its asymptote) of
+// a and b, beyond the bounding box. It does not depend on where the segment starts unless the
+// start is already past it, so every piece of an edge ends at the same spot.
+template <typename T, typename Geometry>
+Point BasicFortuneAlgorithm<T, Geometry>::ray_end(const Point& a, const Point& b, const Point& start, const Point& dir) const {
+    const double len = std::hypot(dir.x, dir.y);
+    const Point u{dir.x / len, dir.y / len};
+    const Point m{(a.x + b.x) / 2, (a.y + b.y) / 2};
+    const double reach = std::hypot(m.x - (x_min + x_max) / 2, m.y - (y_min + y_max) / 2)
+                       + std::hypot(x_max - x_min, y_max - y_min);
+    const double from = (start.x - m.x) * u.x + (start.y - m.y) * u.y;
+    const double t = from < reach ? reach : from + reach;
+    return {m.x + t * u.x, m.y + t * u.y};
+}
+
+void EventQueue::push(Event* e) {
+    heap.push_back(e);
+    sift_up(heap.size() - 1, e);
+}
+
+Event* EventQueue::pop() {
+    Event* e = heap.front();
+    Event* last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) sift_down(0, last);
+    return e;
+}
+
+void EventQueue::remove(Event* e) {
+    const std::size_t i = e->heap_index;
+    Event* last = heap.back();
+    heap.pop_back();
+    if (i == heap.size()) return;
     
-    double a = 0.0, b = 0.0;
-    if (i->prev) // Get intersection of i->prev, i
-        a = intersection(i->prev->p, i->p, p.x).y;
-    if (i->next) // Get intersection of i->next, i
-        b = intersection(i->p, i->next->p, p.x).y;
-    
-    if ((!i->prev || a <= p.y) && (!i->next || p.y <= b)) {
-        if (res) {
-            res->y = p.y;
-            // Plug back into parabola equation
-            res->x = (i->p.x * i->p.x + (i->p.y - res->y) * (i->p.y - res->y) - p.x * p.x)
-                   / (2 * i->p.x - 2 * p.x);
+    if (i > 0 && last->x < heap[(i - 1) / 4]->x) {
+        sift_up(i, last);
+    } else {
+        sift_down(i, last);
+    }
+}
+
+// Both sifts move a hole from i and drop e into its final slot
+void EventQueue::sift_up(std::size_t i, Event* e) {
+    while (i > 0) {
+        const std::size_t parent = (i - 1) / 4;
+        if (!(e->x < heap[parent]->x)) break;
+        place(i, heap[parent]);
+        i = parent;
+    }
+    place(i, e);
+}
+
+void EventQueue::sift_down(std::size_t i, Event* e) {
+    const std::size_t n = heap.size();
+    for (;;) {
+        const std::size_t first = 4 * i + 1;
+        if (first >= n) break;
+        
+        std::size_t best = first;
+        const std::size_t last = std::min(first + 4, n);
+        for (std::size_t c = first + 1; c < last; ++c) {
+            if (heap[c]->x < heap[best]->x) best = c;
         }
-        return true;
+        if (!(heap[best]->x < e->x)) break;
+        place(i, heap[best]);
+        i = best;
     }
-    return false;
+    place(i, e);
+}
+
+ArcId BeachLine::front() const {
+    ArcId a = root;
+    while (a && hots[a].left) a = hots[a].left;
+    return a;
+}
+
+void BeachLine::clear() {
+    // Slot 0 is the null arc
+    hots.assign(1, ArcHot{});
+    trees.assign(1, ArcTree{});
+    colds.assign(1, ArcCold{});
+    root = 0;
+    free_list = 0;
+    live = 0;
 }
 
-Point FortuneAlgorithm::intersection(const Point& p0, const Point& p1, double l) const {
-    Point res;
-    Point p = p0;
+void BeachLine::reserve(std::size_t n) {
+    hots.reserve(n + 1);
+    trees.reserve(n + 1);
+    colds.reserve(n + 1);
+}
+
+void BeachLine::insert_after(ArcId pos, ArcId a) {
+    trees[a].priority = next_priority();
+    hots[a].left = hots[a].right = 0;
+    
+    const ArcId succ = pos ? hots[pos].next : front();
+    hots[a].prev = pos;
+    hots[a].next = succ;
+    if (pos) hots[pos].next = a;
+    if (succ) hots[succ].prev = a;
     
-    if (p0.x == p1.x) {
-        res.y = (p0.y + p1.y) / 2;
-    } else if (p1.x == l) {
-        res.y = p1.y;
-    } else if (p0.x == l) {
-        res.y = p0.y;
-        p = p1;
+    // The in-order successor of pos is either pos->right (when empty) or
+    // the leftmost node of pos's right subtree, which is succ
+    if (pos && !hots[pos].right) {
+        hots[pos].right = a;
+        trees[a].parent = pos;
+    } else if (succ) {
+        hots[succ].left = a;
+        trees[a].parent = succ;
     } else {
-        // Use quadratic formula
-        const double z0 = 2 * (p0.x - l);
-        const double z1 = 2 * (p1.x - l);
-        
-        const double a = 1/z0 - 1/z1;
-        const double b = -2 * (p0.y/z0 - p1.y/z1);
-        const double c = (p0.y*p0.y + p0.x*p0.x - l*l)/z0
-                       - (p1.y*p1.y + p1.x*p1.x - l*l)/z1;
-        
-        res.y = (-b - std::sqrt(b*b - 4*a*c)) / (2*a);
+        root = a;
+        trees[a].parent = 0;
+    }
+    
+    while (trees[a].parent && trees[trees[a].parent].priority < trees[a].priority) {
+        rotate_up(a);
     }
-    // Plug back into one of the parabola equations
-    res.x = (p.x*p.x + (p.y-res.y)*(p.y-res.y) - l*l)/(2*p.x-2*l);
-    return res;
 }
 
-void FortuneAlgorithm::finish_edges() {
-    // Advance the sweep line so no parabolas can cross the bounding box
-    const double l = x_max + (x_max - x_min) + (y_max - y_min);
+void BeachLine::erase(ArcId a) {
+    const ArcId p = hots[a].prev;
+    const ArcId n = hots[a].next;
+    if (p) hots[p].next = n;
+    if (n) hots[n].prev = p;
     
-    // Extend each remaining segment
-    for (ArcPtr i = root; i->next != nullptr; i = i->next) {
-        if (i->right_segment) {
-            i->right_segment->finish(intersection(i->p, i->next->p, l * 2));
+    // Rotate a down to a leaf, then detach it
+    while (hots[a].left || hots[a].right) {
+        const ArcId l = hots[a].left;
+        const ArcId r = hots[a].right;
+        if (!r || (l && trees[l].priority > trees[r].priority)) {
+            rotate_up(l);
+        } else {
+            rotate_up(r);
         }
     }
+    owner(a) = 0;
+    trees[a].parent = 0;
+}
+
+unsigned BeachLine::next_priority() {
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+ArcId& BeachLine::owner(ArcId a) {
+    const ArcId p = trees[a].parent;
+    if (!p) return root;
+    return hots[p].left == a ? hots[p].left : hots[p].right;
+}
+
+void BeachLine::rotate_up(ArcId x) {
+    const ArcId p = trees[x].parent;
+    ArcId& slot = owner(p);
+    
+    if (hots[p].left == x) {
+        hots[p].left = hots[x].right;
+        if (hots[p].left) trees[hots[p].left].parent = p;
+        hots[x].right = p;
+    } else {
+        hots[p].right = hots[x].left;
+        if (hots[p].right) trees[hots[p].right].parent = p;
+        hots[x].left = p;
+    }
+    trees[x].parent = trees[p].parent;
+    trees[p].parent = x;
+    slot = x;
 }
 
-} // namespace Voronoi
\ No newline at end of file
+template class BasicFortuneAlgorithm<double>;
+template class BasicFortuneAlgorithm<float>;
+template class BasicFortuneAlgorithm<std::int32_t>;
+template class BasicFortuneAlgorithm<double, AdditiveWeights>;
+
+} // namespace Voronoi
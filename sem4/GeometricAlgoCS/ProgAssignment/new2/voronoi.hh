@@ -1,36 +1,39 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <span>
+#include <functional>
 #include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
 #include <cmath>
 #include <iostream>
+#include <type_traits>
+#include <utility>
 
-namespace Voronoi {
+#include "cells.hh"
+#include "clip.hh"
+#include "diagram.hh"
+#include "geometry.hh"
+#include "point.hh"
+#include "pool.hh"
+#include "site_index.hh"
+#include "snapshot.hh"
+#include "stats.hh"
+#include "triangulation.hh"
 
-struct Point {
-    double x;
-    double y;
-    
-    Point(double x = 0.0, double y = 0.0) : x(x), y(y) {}
-    
-    bool operator==(const Point& other) const {
-        return x == other.x && y == other.y;
-    }
-    
-    bool operator!=(const Point& other) const {
-        return !(*this == other);
-    }
-};
+namespace Voronoi {
 
-struct Segment {
-    Point start;
-    Point end;
+template <typename T>
+struct BasicSegment {
+    BasicPoint<T> start;
+    BasicPoint<T> end;
     bool done;
     
-    Segment(const Point& p) : start(p), end(), done(false) {}
+    BasicSegment(const BasicPoint<T>& p) : start(p), end(), done(false) {}
     
-    void finish(const Point& p) {
+    void finish(const BasicPoint<T>& p) {
         if (!done) {
             end = p;
             done = true;
@@ -38,72 +41,409 @@ struct Segment {
     }
 };
 
-class Arc;
+using Segment = BasicSegment<double>;
+
 class Event;
 
-using ArcPtr = std::shared_ptr<Arc>;
-using EventPtr = std::shared_ptr<Event>;
-using SegmentPtr = std::shared_ptr<Segment>;
+// Arcs are slots in the arrays of the BeachLine, and slot 0 stands for no
+// arc. What the descent and the circle checks read at every arc they pass
+// (its site and its list and tree links) is one 32-byte record, two to a
+// cache line; the treap's balancing data and the per-arc bookkeeping of
+// the output are kept in arrays of their own. Open segments are referred
+// to by their slot in BasicFortuneAlgorithm's table of starts, and diagram
+// edges by the index k of their half-edge pair (the same index keys the
+// pending triangles of an edge while the triangulation is built).
+using ArcId = std::uint32_t;
+
+struct ArcHot {
+    Point p;    // Site, in double
+    ArcId prev; // Beach-line neighbours
+    ArcId next;
+    ArcId left; // Treap children
+    ArcId right;
+};
+static_assert(sizeof(ArcHot) == 32);
+
+struct ArcTree {
+    ArcId parent;
+    unsigned priority;
+};
+
+struct ArcCold {
+    int site; // Index in insertion order
+    Event* event;
+    int left_segment;
+    int right_segment;
+    int left_edge;
+    int right_edge;
+};
 
-class Arc {
+// Treap over the arcs of the beach line. In-order traversal matches the
+// prev/next list, so arcs can be searched by breakpoint in O(log n) while
+// neighbours stay reachable in O(1). Owns the storage of the arcs: clear()
+// drops them all and keeps the arrays for the next run. Creating an arc
+// may move the arrays, so references from hot() and cold() do not live
+// across create().
+class BeachLine {
 public:
-    Point p;
-    ArcPtr prev;
-    ArcPtr next;
-    EventPtr event;
-    SegmentPtr left_segment;
-    SegmentPtr right_segment;
-    
-    Arc(const Point& pp, ArcPtr a = nullptr, ArcPtr b = nullptr)
-        : p(pp), prev(a), next(b), event(nullptr), left_segment(nullptr), right_segment(nullptr) {}
+    ArcId root = 0;
+    
+    BeachLine() { clear(); }
+    
+    bool empty() const { return root == 0; }
+    std::size_t size() const { return live; }
+    ArcId front() const;
+    
+    ArcId create(Point p, int site) {
+        ++live;
+        const ArcId a = free_list;
+        if (!a) {
+            hots.push_back({p, 0, 0, 0, 0});
+            trees.push_back({0, 0});
+            colds.push_back({site, nullptr, -1, -1, -1, -1});
+            return static_cast<ArcId>(hots.size() - 1);
+        }
+        free_list = hots[a].next;
+        hots[a] = {p, 0, 0, 0, 0};
+        colds[a] = {site, nullptr, -1, -1, -1, -1};
+        return a;
+    }
+    void destroy(ArcId a) {
+        hots[a].next = free_list;
+        free_list = a;
+        --live;
+    }
+    void clear();
+    void reserve(std::size_t n);
+    
+    // Links a right after pos (or at the front if pos is 0)
+    void insert_after(ArcId pos, ArcId a);
+    // Unlinks a; its own prev/next are left pointing at the old neighbours
+    void erase(ArcId a);
+    
+    ArcHot& hot(ArcId a) { return hots[a]; }
+    const ArcHot& hot(ArcId a) const { return hots[a]; }
+    ArcCold& cold(ArcId a) { return colds[a]; }
+    const ArcCold& cold(ArcId a) const { return colds[a]; }
+    ArcId prev(ArcId a) const { return hots[a].prev; }
+    ArcId next(ArcId a) const { return hots[a].next; }
+    
+private:
+    std::vector<ArcHot> hots;
+    std::vector<ArcTree> trees;
+    std::vector<ArcCold> colds;
+    ArcId free_list = 0; // Destroyed slots, chained through next
+    std::size_t live = 0;
+    unsigned seed = 0x9e3779b9u;
+    
+    unsigned next_priority();
+    ArcId& owner(ArcId a);
+    void rotate_up(ArcId x);
 };
 
 class Event {
 public:
     double x;
     Point p;
-    ArcPtr arc;
-    bool valid;
+    ArcId arc;
+    std::size_t heap_index; // Position in the EventQueue, kept up to date by it
+    
+    Event(double xx, const Point& pp, ArcId aa)
+        : x(xx), p(pp), arc(aa), heap_index(0) {}
+};
+
+// Indexed 4-ary min-heap of circle events keyed on sweep position x. Every
+// event knows its slot, so a stale event is removed as soon as its arc's
+// neighbours change instead of waiting to be popped.
+class EventQueue {
+public:
+    bool empty() const { return heap.empty(); }
+    std::size_t size() const { return heap.size(); }
+    Event* top() const { return heap.front(); }
+    void reserve(std::size_t n) { heap.reserve(n); }
+    
+    void push(Event* e);
+    Event* pop();
+    void remove(Event* e);
     
-    Event(double xx, const Point& pp, ArcPtr aa)
-        : x(xx), p(pp), arc(aa), valid(true) {}
+private:
+    std::vector<Event*> heap;
+    
+    void place(std::size_t i, Event* e) {
+        heap[i] = e;
+        e->heap_index = i;
+    }
+    void sift_up(std::size_t i, Event* e);
+    void sift_down(std::size_t i, Event* e);
+};
+
+// Receives each segment as soon as the sweep finishes it
+template <typename T>
+using BasicEdgeSink = std::function<void(const BasicSegment<T>&)>;
+using EdgeSink = BasicEdgeSink<double>;
+
+// Outcome of BasicFortuneAlgorithm::relax
+struct RelaxResult {
+    int steps;           // Lloyd steps taken
+    double displacement; // Largest move the next step would make
 };
 
-class FortuneAlgorithm {
+// Fortune's sweep over sites with coordinates of type T: double, float, or
+// int32_t for sites on an integer grid. Sites and output segments are kept
+// as T, which halves their size for the 32-bit types; the sweep itself
+// computes in double, which holds float and int32_t sites exactly, and the
+// half-edge diagram keeps double vertices. Integer segment ends are rounded
+// to the grid, so integer sites should stay well inside the int32_t range
+// for the rays cut off beyond the bounding box.
+//
+// Geometry is the distance the diagram is taken in (geometry.hh). Weighted
+// geometries are built for double sites, and only compute() and
+// compute_parallel() (which then runs serially) apply to them: the stream,
+// cell, locate, edit and relax calls assume the ordinary diagram.
+template <typename T, typename Geometry = Euclidean>
+class BasicFortuneAlgorithm {
+    static_assert(std::is_same_v<T, double> || std::is_same_v<T, float> || std::is_same_v<T, std::int32_t>,
+                  "coordinates are double, float or int32_t");
+                  
 public:
-    FortuneAlgorithm() = default;
+    using Site = BasicPoint<T>;
+    using Segment = BasicSegment<T>;
+    using EdgeSink = BasicEdgeSink<T>;
     
-    void add_point(const Point& p);
+    BasicFortuneAlgorithm() = default;
+    
+    void add_point(const Site& p);
+    // Bulk insert; input already sorted by x (then y) skips the sort in compute()
+    void add_points(std::span<const Site> ps);
+    // Sites with their weights, for weighted geometries; sites added
+    // without one weigh 0
+    void add_point(const Site& p, double w) requires Geometry::weighted;
+    void add_points(std::span<const Site> ps, std::span<const double> ws) requires Geometry::weighted;
+    // Forget the sites and everything computed from them, for a new set of
+    // sites on the same object. Settings (flags, clip region, edge sink)
+    // stay, and so does all storage, so a run no bigger than an earlier one
+    // does not allocate.
+    void reset();
+    // Size the storage for n sites up front: about 4n segments, 3n edges,
+    // 2n vertices and triangles, and O(sqrt n) arcs and events
+    void reserve(std::size_t n);
+    // Every compute() starts from the current sites and replaces the
+    // results of the last one
     void compute();
-    std::vector<SegmentPtr> get_segments() const;
-    int locate_cell(const Point& q) const;
+    // Sweeps sites already sorted by x, then y, straight from sorted (a
+    // mapped site file, say) in place of the added ones. Nothing but the
+    // beach line and the pending events stays resident, so this needs an
+    // edge sink and builds neither the diagram, the triangulation nor the
+    // locate index.
+    void compute_stream(std::span<const Site> sorted) requires (!Geometry::weighted);
+    // compute_stream() from unsorted sites, sorting while it sweeps: a
+    // producer thread copies the sites out chunk by chunk (faulting in a
+    // mapped file front to back), workers sort the chunks and then merge
+    // them one x-range at a time, and the sweep starts on the lowest range
+    // as soon as it is merged. With an edge sink, the segments go to it in
+    // batches on a thread of its own, so the sink's I/O overlaps the sweep;
+    // without one they are collected as by compute(). Runs on threads - 1
+    // sorting workers (at least one) besides the producer, the sink's
+    // thread and the caller's, which sweeps. Builds neither the diagram,
+    // the triangulation nor the locate index.
+    void compute_pipelined(std::span<const Site> sites, unsigned threads = std::thread::hardware_concurrency())
+        requires (!Geometry::weighted);
+    // compute() split over a kd-partition of the sites, one sweep per
+    // thread plus a seam pass. Produces the same Voronoi edges, one
+    // segment per edge (the serial sweep may split an edge at the point
+    // where its site arrived). Runs serially when the diagram or the
+    // triangulation is requested.
+    void compute_parallel(unsigned threads = std::thread::hardware_concurrency());
+    // Finished segments, in the order the sweep finished them
+    std::vector<Segment> get_segments() const;
+    // View of the segments, valid until the next compute()
+    std::span<const Segment> segments() const;
+    // Stream segments to sink during compute() instead of keeping them;
+    // an empty sink switches back to collecting
+    void set_edge_sink(EdgeSink sink) { edge_sink = std::move(sink); }
+    const EdgeSink& get_edge_sink() const { return edge_sink; }
+    // Also build the half-edge structure during compute(); off by default
+    void set_build_diagram(bool on) { build_diagram = on; }
+    const Diagram& get_diagram() const { return diagram; }
+    // Also collect the Delaunay triangles during compute(), one per circle
+    // event, with their adjacency; off by default. Edits leave it alone.
+    void set_build_triangulation(bool on) { build_triangulation = on; }
+    const Triangulation& get_triangulation() const { return triangulation; }
+    // Build the nearest-site index for locate_cell during compute(); on by
+    // default for the ordinary diagram
+    void set_build_index(bool on) { build_index = on; }
+    // Keep only the parts of edges inside a rectangle or a convex polygon
+    // (counterclockwise). Edges that miss it are dropped as they finish;
+    // the half-edge diagram is not clipped.
+    void set_clip_rect(double x0, double y0, double x1, double y1) { clip = ClipPolygon::rect(x0, y0, x1, y1); }
+    void set_clip_polygon(std::span<const Point> ccw) { clip = ClipPolygon(ccw); }
+    void clear_clip() { clip = ClipPolygon(); }
+    // Cell of site s cut to the clip region (or the bounding box), closed
+    // along the border. Needs the diagram; empty for a site without a cell.
+    std::vector<Point> cell_polygon(int s) const requires (!Geometry::weighted);
+    // Index (in insertion order) of the site whose cell contains q
+    int locate_cell(const Point& q) const requires (!Geometry::weighted);
+    // locate_cell for a batch of queries; out must hold queries.size() entries
+    void locate_cells(std::span<const Point> queries, std::span<int> out) const requires (!Geometry::weighted);
+    // The k sites nearest to q, nearest first, into out; fewer only if
+    // fewer sites have a cell. Grows from locate_cell(q) through the cells'
+    // neighbours, as the i+1st nearest site always borders one of the i
+    // before it, so it needs the diagram. Duplicate sites have no cell of
+    // their own and are left out.
+    void nearest_k(const Point& q, std::size_t k, std::vector<int>& out, NeighborScratch& scratch) const
+        requires (!Geometry::weighted);
+    // Every site within distance r of q, nearest first, into out; same
+    // walk and needs as nearest_k
+    void within_radius(const Point& q, double r, std::vector<int>& out, NeighborScratch& scratch) const
+        requires (!Geometry::weighted);
+    // Copy of what the queries above read, as left by compute() and any
+    // edits since, for readers on other threads to keep querying while
+    // this goes on to the next compute(); see Publisher
+    std::unique_ptr<const BasicSnapshot<T>> snapshot() const requires (!Geometry::weighted);
+    // Edit the diagram of the last compute() in place, touching only the
+    // cells around the site. Needs set_build_diagram(true) before compute();
+    // get_diagram() and locate_cell follow the edits, segments() does not.
+    // insert_site returns the new site's index (or that of an equal live
+    // site); remove_site returns false if s is not a live site.
+    // Once the edits since compute() or the last compaction pass a quarter
+    // of the sites, the edit ends by dropping the removed sites, numbering
+    // the live ones afresh in the same order and rebuilding the index.
+    int insert_site(const Site& p) requires (!Geometry::weighted);
+    bool remove_site(int s) requires (!Geometry::weighted);
+    // Old index -> new index (-1 if removed) if the last edit compacted the
+    // sites, else empty; insert_site already returns the new index
+    const std::vector<int>& renumbering() const { return renumbered; }
+    // Lloyd relaxation: computes, moves every site to the centroid of its
+    // cell and computes again, until no site would move more than tolerance
+    // or after max_steps steps. Cells are cut to the clip region, or to the
+    // sites' bounding box as it is when relax() starts. The steps share the
+    // sweep's storage and the index's, and each sort starts from the last
+    // order, which the small moves hardly disturb. Ends with the diagram,
+    // segments and index of the final sites, which are all an edge sink gets.
+    RelaxResult relax(int max_steps, double tolerance = 0.0) requires (!Geometry::weighted);
     void print_output() const;
-    
+#ifdef VORONOI_STATS
+    // Counters and phase times of the last compute()
+    const SweepStats& stats() const { return sweep_stats; }
+#endif
+
 private:
-    ArcPtr root = nullptr;
-    std::priority_queue<Point, std::vector<Point>, std::greater<>> points;
-    std::priority_queue<EventPtr, std::vector<EventPtr>, std::greater<>> events;
-    std::vector<SegmentPtr> output_segments;
+    [[no_unique_address]] Geometry geometry;
+    BeachLine beach;
+    std::vector<Site> sites;             // Input order
+    std::vector<std::uint32_t> order;    // Sites sorted by x, then y; empty for a stream
+    std::span<const Site> sweep_sites;   // Sites or the stream being swept
+    std::size_t next_site = 0;           // Sweep position in order
+    EventQueue events;
+    std::vector<Segment> output_segments;
+    EdgeSink edge_sink;
+    std::vector<Point> open_starts; // Start of each open segment, kept in double until it finishes
+    std::vector<int> free_segments; // Slots of open_starts ready for reuse
+    ClipPolygon clip;
+    bool build_diagram = false;
+    Diagram diagram;
+    bool build_triangulation = false;
+    Triangulation triangulation;
+    std::vector<int> edge_triangles; // Per sweep edge: 3t + corner of its first triangle, or -1
+    std::vector<std::pair<int, int>> duplicates; // Equal sites: one without a cell, the one with it
+    SiteIndex site_index; // Built by compute() for locate_cell, and again by edits
+    bool build_index = !Geometry::weighted; // Off for the sub-sweeps of compute_parallel
+    
+    // State of insert_site/remove_site, empty until the first edit
+    std::vector<char> removed;
+    std::vector<int> moved_to;     // Removed site -> a former neighbour
+    std::vector<int> free_vertices; // Diagram slots freed by edits
+    std::vector<int> free_edges;
+    std::size_t edits_since_index = 0; // Edits since the sites were last indexed
+    std::vector<int> renumbered;       // Left by the last edit if it compacted
+    // Sweep of the sites around an edit, kept with its storage for the next
+    std::unique_ptr<BasicFortuneAlgorithm> edit_sweep;
+    
+    // Per-run storage for the sweep structures
+    Pool<Event> event_pool;
+    std::vector<std::uint64_t> sort_keys, sort_keys_tmp; // Radix sort scratch
+    std::vector<std::uint32_t> order_tmp;
+    std::vector<std::size_t> sort_counts;
     
     double x_min = 0.0, x_max = 0.0, y_min = 0.0, y_max = 0.0;
+
+#ifdef VORONOI_STATS
+    mutable SweepStats sweep_stats; // breakpoint() is const
+#endif
+
+    // The queries' view of the sites, the diagram and the index
+    CellView<T> cells() const { return {sites, diagram, site_index, duplicates, removed, moved_to}; }
     
+    // Sites in sweep order: by the position where they enter, then by y
+    double key(std::uint32_t s) const { return geometry.key(sweep_sites[s], static_cast<int>(s)); }
+    bool sweeps_before(std::uint32_t i, std::uint32_t j) const {
+        const double ki = key(i), kj = key(j);
+        return ki < kj || (ki == kj && sweep_sites[i].y < sweep_sites[j].y);
+    }
+    // Drops the results of the last compute() and the edits since: the
+    // segments, the diagram with its free lists, the triangulation, the
+    // duplicates and the removed sites. Every compute path starts here.
+    void clear_results();
+    void sort_sites();
+    bool repair_order();
+    void frame(std::span<const Site> ps);
+    // Bounding box of the sites, given
+    void frame(double x0, double y0, double x1, double y1);
+    void cover_clip();
+    void sweep();
+    // sweep() in steps, for sites that arrive in order: sweep_until(end)
+    // takes the sites before end with the events they pass
+    void begin_stream(std::span<const Site> sorted);
+    void sweep_until(std::size_t end);
+    void finish_sweep();
+    std::uint32_t sweep_index(std::size_t k) const {
+        return order.empty() ? static_cast<std::uint32_t>(k) : order[k];
+    }
     void process_point();
     void process_event();
-    void front_insert(const Point& p);
-    
-    bool check_circle_event(ArcPtr i, double x0);
-    bool circle(const Point& a, const Point& b, const Point& c, double* x, Point* o) const;
+    void front_insert(std::uint32_t s);
     
-    bool intersect(const Point& p, ArcPtr i, Point* result = nullptr) const;
-    Point intersection(const Point& p0, const Point& p1, double l) const;
+    int new_segment(const Point& start);
+    void finish_segment(int s, const Point& p);
+    // Edge between the cells of a and b as the sweep meets it, for the
+    // diagram, the triangulation or both
+    int sweep_edge(int a, int b);
+    void add_triangle(int a, int b, int c, int bc, int ca, int ab);
+    // Diagram bookkeeping, only called when build_diagram is set
+    int new_edge(int a, int b);
+    int new_vertex(const Point& p, int leaving);
+    int half_edge(int edge, int face) const;
+    void link(int h, int next);
+    void finish_diagram();
+    void find_duplicates();
+    // Incremental edits, see incremental.cpp
+    void begin_edit();
+    void take_cell(int s);
+    // Compacts and reindexes the sites once enough edits have gone by
+    void end_edit();
+    void compact_sites();
+    // Diagram of the given sites on their own, valid until the next call;
+    // faces are positions in ids
+    const Diagram& local_diagram(std::span<const std::uint32_t> ids);
+    void give_cell(int s, int to);
+    void rebuild_diagram();
+    bool splice_insert(int s, int s0);
+    bool splice_remove(int s);
+    void delete_vertex(int v);
+    void delete_edge(int edge);
+    void link_vertex(int v, const int leaving[3]);
+    void fix_face(int h);
+    bool check_circle_event(ArcId i, double x0);
+    // Height of the breakpoint between arc lo and arc hi above it
+    double breakpoint(ArcId lo, ArcId hi, double l) const;
     
     void finish_edges();
-    
-    struct EventComparator {
-        bool operator()(const EventPtr& a, const EventPtr& b) const {
-            return a->x > b->x;
-        }
-    };
+    Point ray_end(const Point& a, const Point& b, const Point& start, const Point& dir) const;
 };
 
+using FortuneAlgorithm = BasicFortuneAlgorithm<double>;
+using FortuneAlgorithmF = BasicFortuneAlgorithm<float>;
+using FortuneAlgorithmI = BasicFortuneAlgorithm<std::int32_t>;
+using WeightedFortuneAlgorithm = BasicFortuneAlgorithm<double, AdditiveWeights>;
+
 } // namespace Voronoi
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "window.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace Voronoi {
+
+template <typename T>
+void BasicWindowCells<T>::clear() {
+    segments.clear();
+    sites.clear();
+    corners.clear();
+    offsets.clear();
+    swept = 0;
+    rounds = 0;
+}
+
+template <typename T>
+BasicWindowedDiagram<T>::BasicWindowedDiagram(std::span<const Site> sites, unsigned threads)
+    : sites(sites), selected(sites.size(), 0) {
+    index.build(sites, std::max(threads, 1u));
+    if (!sites.empty()) {
+        double x0 = sites[0].x, x1 = x0, y0 = sites[0].y, y1 = y0;
+        for (const Site& p : sites) {
+            x0 = std::min<double>(x0, p.x);
+            x1 = std::max<double>(x1, p.x);
+            y0 = std::min<double>(y0, p.y);
+            y1 = std::max<double>(y1, p.y);
+        }
+        // Sites on a line still get a halo of about their spacing
+        const double w = std::max(x1 - x0, 1.0), h = std::max(y1 - y0, 1.0);
+        halo = 3.0 * std::sqrt(w * h / static_cast<double>(sites.size()));
+    }
+    // Only the diagram is wanted, to cut the cells out of it
+    sweep.set_build_diagram(true);
+    sweep.set_build_index(false);
+}
+
+template <typename T>
+void BasicWindowedDiagram<T>::compute(double x0, double y0, double x1, double y1, BasicWindowCells<T>& out) {
+    out.clear();
+    if (sites.empty()) return;
+    if (++stamp == 0) {
+        std::fill(selected.begin(), selected.end(), 0);
+        stamp = 1;
+    }
+    
+    // Everything in the halo box is swept, so circles inside it need no check
+    const double hx0 = x0 - halo, hy0 = y0 - halo, hx1 = x1 + halo, hy1 = y1 + halo;
+    chosen.clear();
+    index.in_box(hx0, hy0, hx1, hy1, chosen);
+    for (std::uint32_t s : chosen) selected[s] = stamp;
+    // An empty box still lies in somebody's cell
+    if (chosen.empty()) choose(static_cast<std::uint32_t>(index.nearest({(x0 + x1) / 2, (y0 + y1) / 2})));
+    
+    sweep.set_clip_rect(x0, y0, x1, y1);
+    const std::vector<Point> sweep_window = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+    for (;;) {
+        ++out.rounds;
+        subset.clear();
+        for (std::uint32_t s : chosen) subset.push_back(sites[s]);
+        sweep.reset();
+        sweep.add_points(subset);
+        sweep.compute();
+        
+        out.sites.clear();
+        out.corners.clear();
+        out.offsets.assign(1, 0);
+        const std::size_t before = chosen.size();
+        // Copies of one site have no edges between them, and no cells either
+        const bool one_site = sweep.get_diagram().half_edges.empty();
+        for (std::size_t i = 0; i < before; ++i) {
+            const std::vector<Point> cell = !one_site ? sweep.cell_polygon(static_cast<int>(i))
+                : i == 0 ? sweep_window : std::vector<Point>();
+            if (cell.empty()) continue;
+            out.sites.push_back(static_cast<int>(chosen[i]));
+            out.corners.insert(out.corners.end(), cell.begin(), cell.end());
+            out.offsets.push_back(out.corners.size());
+            
+            const Point s = subset[i];
+            for (const Point& v : cell) {
+                const double dx = v.x - s.x, dy = v.y - s.y;
+                const double r2 = dx * dx + dy * dy, r = std::sqrt(r2);
+                if (v.x - r >= hx0 && v.x + r <= hx1 && v.y - r >= hy0 && v.y + r <= hy1) continue;
+                
+                found.clear();
+                index.in_box(v.x - r, v.y - r, v.x + r, v.y + r, found);
+                for (std::uint32_t z : found) {
+                    if (selected[z] == stamp) continue;
+                    const double zx = v.x - sites[z].x, zy = v.y - sites[z].y;
+                    if (zx * zx + zy * zy < r2) choose(z);
+                }
+            }
+        }
+        if (chosen.size() == before) break;
+    }
+    
+    const auto segs = sweep.segments();
+    out.segments.assign(segs.begin(), segs.end());
+    out.swept = chosen.size();
+}
+
+template struct BasicWindowCells<double>;
+template struct BasicWindowCells<float>;
+template struct BasicWindowCells<std::int32_t>;
+template class BasicWindowedDiagram<double>;
+template class BasicWindowedDiagram<float>;
+template class BasicWindowedDiagram<std::int32_t>;
+
+} // namespace Voronoi
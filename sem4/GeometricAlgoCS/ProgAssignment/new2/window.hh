@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "point.hh"
+#include "site_index.hh"
+#include "voronoi.hh"
+
+namespace Voronoi {
+
+// What BasicWindowedDiagram::compute finds in a window
+template <typename T>
+struct BasicWindowCells {
+    std::vector<BasicSegment<T>> segments; // Voronoi edges cut to the window
+    std::vector<int> sites;                // Sites whose cells reach the window
+    // Cell of sites[i] cut to the window, counterclockwise: corners[offsets[i]]
+    // up to corners[offsets[i + 1]]
+    std::vector<Point> corners;
+    std::vector<std::size_t> offsets;
+    std::size_t swept = 0; // Sites the last sweep ran on
+    int rounds = 0;        // Sweeps, one more for each failed validation
+    
+    std::size_t size() const { return sites.size(); }
+    std::span<const Point> cell(std::size_t i) const {
+        return std::span<const Point>(corners).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    void clear();
+};
+
+// The cells of a large, fixed site set that reach a window, without
+// sweeping all of it. The sites are indexed once; a window then sweeps
+// only the sites in the window grown by a halo, and checks the result: a
+// site left out is closer than s to some point of s's cell only if it is
+// closer to one of the cell's corners, so every corner whose circle
+// through s leaves the halo is looked up in the index. Sites found inside
+// such a circle are added and the subset swept again. A window costs
+// O(log n) plus the sweep of its own neighbourhood, whatever n is.
+template <typename T>
+class BasicWindowedDiagram {
+public:
+    using Site = BasicPoint<T>;
+    
+    // sites must stay alive and unchanged for as long as this is used. The
+    // index is built on up to threads threads.
+    explicit BasicWindowedDiagram(std::span<const Site> sites,
+                                  unsigned threads = std::thread::hardware_concurrency());
+    
+    // How far around the window sites are swept before validation; by
+    // default three times the mean site spacing. Any halo gives the same
+    // cells, a tight one just takes more rounds.
+    void set_halo(double h) { halo = h; }
+    double get_halo() const { return halo; }
+    
+    // Cells reaching [x0, x1] x [y0, y1], replacing out's contents and
+    // reusing its storage. One compute() at a time.
+    void compute(double x0, double y0, double x1, double y1, BasicWindowCells<T>& out);
+    
+private:
+    std::span<const Site> sites;
+    SiteIndex index;
+    double halo = 0.0;
+    BasicFortuneAlgorithm<T> sweep;
+    
+    // Per-compute storage
+    std::vector<std::uint32_t> chosen; // Sites swept, in the sweep's order
+    std::vector<std::uint32_t> found;
+    std::vector<Site> subset;
+    std::vector<std::uint32_t> selected; // Per site: last compute() that chose it
+    std::uint32_t stamp = 0;
+    
+    void choose(std::uint32_t s) {
+        selected[s] = stamp;
+        chosen.push_back(s);
+    }
+};
+
+using WindowCells = BasicWindowCells<double>;
+using WindowedDiagram = BasicWindowedDiagram<double>;
+using WindowedDiagramF = BasicWindowedDiagram<float>;
+using WindowedDiagramI = BasicWindowedDiagram<std::int32_t>;
+
+} // namespace Voronoi